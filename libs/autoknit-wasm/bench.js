@@ -0,0 +1,34 @@
+"use strict";
+
+// Usage: node bench.js corpus.json [max_racking]
+// where the corpus is a JSON list of { from, to, params } problems
+// (e.g. recorded with xfer.start_recording() / xfer.stop_recording())
+const fs = require('fs');
+const corpusFile = process.argv[2];
+const max_racking = parseInt(process.argv[3]) || 0;
+if(!corpusFile){
+  console.log('Usage: node bench.js corpus.json [max_racking]');
+  process.exit(1);
+}
+const corpus = JSON.parse(fs.readFileSync(corpusFile, 'utf8'));
+
+const xfer_module = require('./plan_transfers.js');
+xfer_module().then(xfer => {
+  const params = max_racking ? { max_racking } : {};
+  const report = xfer.benchmark_transfers(corpus, params);
+
+  console.log('Problems: ' + report.problems
+    + ', planned: ' + report.planned
+    + ', valid: ' + report.valid);
+  console.log('Time: ' + report.time.toFixed(2) + 'ms'
+    + ' (mean ' + (report.time / Math.max(1, report.problems)).toFixed(3) + 'ms'
+    + ', max ' + report.maxTime.toFixed(3) + 'ms)');
+  console.log('Transfers: ' + report.transfers
+    + ', passes: ' + report.passes
+    + ', racking changes: ' + report.rackingChanges
+    + ', empty transfers: ' + report.emptyTransfers);
+  for(const { index, error, errorIndex } of report.failures)
+    console.log('Problem #' + index + ': ' + error
+      + (errorIndex >= 0 ? ' at #' + errorIndex : ''));
+  process.exit(report.valid === report.problems ? 0 : 1);
+});
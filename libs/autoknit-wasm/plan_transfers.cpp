@@ -1,6 +1,9 @@
 #include <emscripten.h>
+#include <algorithm>
+#include <cstdlib>
 
 #include "../autoknit/plan_transfers.hpp"
+#include "../wasm_stats.h"
 
 typedef std::vector<BedNeedle> NeedleList;
 typedef std::vector<Slack> SlackList;
@@ -13,8 +16,41 @@ struct TransferInput {
 
 typedef std::vector<Transfer> TransferOutput;
 
+const uint32_t stats_module_id = STATS_XFER;
+
+// packed input, as one array per field (filled from JS typed arrays)
+struct PackedInput {
+    std::vector<uint8_t> from_beds;
+    std::vector<int32_t> from_offsets;
+    std::vector<uint8_t> to_beds;
+    std::vector<int32_t> to_offsets;
+    std::vector<int32_t> slacks;
+    std::vector<char>    text; // knitout needle names, separated by spaces
+};
+
+// replay statistics of a transfer list
+struct TransferStats {
+    uint32_t transfers       = 0;
+    uint32_t passes          = 0;  // runs with the same racking and direction
+    uint32_t racking_changes = 0;  // from an initial racking of 0
+    uint32_t max_racking     = 0;  // largest absolute racking used
+    uint32_t empty_transfers = 0;  // transfers without any loop
+    int32_t  error_index     = -1; // transfer (or loop) of the first error
+};
+
+enum SimulationResult : uint8_t {
+    Valid           = 0,
+    InvalidTransfer = 1, // not between front and back beds
+    RackingLimit    = 2,
+    SlackLimit      = 3,
+    FreeRange       = 4,
+    FinalMismatch   = 5  // loop not on its bed_to needle
+};
+
 static Constraints constr;
 static TransferInput input;
+static PackedInput packed;
+static TransferStats stats;
 static TransferOutput output;
 static std::string error;
 
@@ -23,6 +59,7 @@ extern "C" {
     // main transfer planning function
     EMSCRIPTEN_KEEPALIVE
     uint8_t plan_cse_transfers(){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
         // execute planning
         if(plan_transfers(constr, input.bed_from, input.bed_to, input.slacks, &output, &error)){
             return 1; // it worked!
@@ -64,6 +101,7 @@ extern "C" {
     }
     EMSCRIPTEN_KEEPALIVE
     void allocate_input(uint32_t needle_count){
+        StatsPhaseTimer timer(PHASE_SETUP);
         input.bed_from.resize(needle_count);
         input.bed_to.resize(needle_count);
         input.slacks.resize(needle_count);
@@ -102,6 +140,128 @@ extern "C" {
     void set_slack(uint32_t needle_index, Slack slack){
         input.slacks[needle_index] = slack;
     }
+
+    // packed input functions
+    EMSCRIPTEN_KEEPALIVE
+    void allocate_packed_input(uint32_t needle_count){
+        StatsPhaseTimer timer(PHASE_SETUP);
+        packed.from_beds.resize(needle_count);
+        packed.from_offsets.resize(needle_count);
+        packed.to_beds.resize(needle_count);
+        packed.to_offsets.resize(needle_count);
+        packed.slacks.resize(needle_count);
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint8_t *get_packed_from_beds(){
+        return packed.from_beds.data();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int32_t *get_packed_from_offsets(){
+        return packed.from_offsets.data();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint8_t *get_packed_to_beds(){
+        return packed.to_beds.data();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int32_t *get_packed_to_offsets(){
+        return packed.to_offsets.data();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int32_t *get_packed_slacks(){
+        return packed.slacks.data();
+    }
+    bool is_valid_side(uint8_t side){
+        return side == 'f' || side == 'F' || side == 'b' || side == 'B';
+    }
+
+    /**
+     * Validate the packed input and fill the planning input with it.
+     * Sides use the same codes as set_from_needle ('f', 'F', 'b', 'B').
+     *
+     * @param with_slack whether to use the packed slacks (else they are kept)
+     * @return -1 on success, else the index of the first invalid needle
+     *         (i for bed_from[i], N+i for bed_to[i], 2N+i for slacks[i])
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int32_t set_packed_input(uint8_t with_slack){
+        StatsPhaseTimer timer(PHASE_SETUP);
+        const size_t N = packed.from_beds.size();
+        for(size_t i = 0; i < N; ++i){
+            if(!is_valid_side(packed.from_beds[i]))
+                return i;
+        }
+        for(size_t i = 0; i < N; ++i){
+            if(!is_valid_side(packed.to_beds[i]))
+                return N + i;
+        }
+        if(with_slack){
+            for(size_t i = 0; i < N; ++i){
+                if(packed.slacks[i] < 0)
+                    return 2 * N + i;
+            }
+        }
+        allocate_input(N);
+        for(size_t i = 0; i < N; ++i){
+            input.bed_from[i].bed = side_to_bed(packed.from_beds[i]);
+            input.bed_from[i].needle = packed.from_offsets[i];
+            input.bed_to[i].bed = side_to_bed(packed.to_beds[i]);
+            input.bed_to[i].needle = packed.to_offsets[i];
+        }
+        if(with_slack)
+            input.slacks.assign(packed.slacks.begin(), packed.slacks.end());
+        return -1;
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    char *allocate_needle_text(uint32_t num_bytes){
+        StatsPhaseTimer timer(PHASE_SETUP);
+        packed.text.resize(num_bytes + 1);
+        packed.text[num_bytes] = 0;
+        return packed.text.data();
+    }
+
+    /**
+     * Parse knitout needle names (f10, bs-2, ...) from the needle text
+     * into the packed beds and offsets, with the from needles first,
+     * followed by the to needles.
+     *
+     * @param needle_count the number of needles of each bed list
+     * @return -1 on success, else the index of the first invalid needle
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int32_t parse_needle_text(uint32_t needle_count){
+        StatsPhaseTimer timer(PHASE_SETUP);
+        allocate_packed_input(needle_count);
+        const char *str = packed.text.data();
+        for(size_t i = 0; i < 2 * needle_count; ++i){
+            while(*str == ' ')
+                ++str;
+            // side
+            uint8_t side = *str++;
+            if(!is_valid_side(side))
+                return i;
+            if((side == 'f' || side == 'b') && *str == 's'){
+                side = side == 'f' ? 'F' : 'B';
+                ++str;
+            }
+            // offset
+            char *end = nullptr;
+            const long offset = std::strtol(str, &end, 10);
+            if(end == str || (*end != ' ' && *end != 0))
+                return i;
+            str = end;
+            if(i < needle_count){
+                packed.from_beds[i] = side;
+                packed.from_offsets[i] = offset;
+            } else {
+                packed.to_beds[i - needle_count] = side;
+                packed.to_offsets[i - needle_count] = offset;
+            }
+        }
+        return -1;
+    }
+
     EMSCRIPTEN_KEEPALIVE
     void set_max_racking(uint32_t racking){
         constr.max_racking = racking;
@@ -119,6 +279,133 @@ extern "C" {
         );
     }
 
+    // simulation functions
+    bool is_front(BedNeedle::Bed bed){
+        return bed == BedNeedle::Front || bed == BedNeedle::FrontSliders;
+    }
+    bool in_free_range(const BedNeedle &n){
+        return constr.min_free <= n.needle && n.needle <= constr.max_free;
+    }
+
+    /**
+     * Replay the output transfers from the bed_from needles and check
+     * that each transfer is valid under the constraints (racking, slack, free range)
+     * and that all loops end on their bed_to needle.
+     *
+     * The slack between consecutive loops is measured along the front bed
+     * at the racking of each transfer (transfers do not move loops physically).
+     *
+     * @return a SimulationResult (Valid = 0), with details in the statistics
+     */
+    EMSCRIPTEN_KEEPALIVE
+    uint8_t simulate_transfers(){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        stats = TransferStats();
+        const size_t N = input.bed_from.size();
+        NeedleList loops = input.bed_from;
+        int32_t racking = 0;
+        bool frontToBack = false;
+        for(size_t t = 0; t < output.size(); ++t){
+            const Transfer &xfer = output[t];
+            stats.error_index = t;
+            if(is_front(xfer.from.bed) == is_front(xfer.to.bed))
+                return InvalidTransfer;
+            if(!in_free_range(xfer.from) || !in_free_range(xfer.to))
+                return FreeRange;
+            // racking such that the back needle n is aligned with the front needle n + r
+            const bool ftb = is_front(xfer.from.bed);
+            const int32_t r = ftb ? xfer.from.needle - xfer.to.needle
+                                  : xfer.to.needle - xfer.from.needle;
+            const uint32_t absR = r < 0 ? -r : r;
+            if(absR > constr.max_racking)
+                return RackingLimit;
+            stats.max_racking = std::max(stats.max_racking, absR);
+
+            // pass and racking statistics
+            if(t == 0 || r != racking || ftb != frontToBack)
+                ++stats.passes;
+            if(r != racking)
+                ++stats.racking_changes;
+            racking = r;
+            frontToBack = ftb;
+
+            // move the loops
+            bool empty = true;
+            for(BedNeedle &n : loops){
+                if(n.bed == xfer.from.bed && n.needle == xfer.from.needle){
+                    n = xfer.to;
+                    empty = false;
+                }
+            }
+            if(empty)
+                ++stats.empty_transfers;
+            ++stats.transfers;
+
+            // slack between consecutive loops
+            for(size_t i = 0; i < N; ++i){
+                const size_t n = i + 1 < N ? i + 1 : 0;
+                const int32_t xi = loops[i].needle + (is_front(loops[i].bed) ? 0 : racking);
+                const int32_t xn = loops[n].needle + (is_front(loops[n].bed) ? 0 : racking);
+                const int32_t d = xi < xn ? xn - xi : xi - xn;
+                if(d > input.slacks[i]){
+                    stats.error_index = t;
+                    return SlackLimit;
+                }
+            }
+        }
+
+        // final positions
+        for(size_t i = 0; i < N; ++i){
+            if(loops[i].bed != input.bed_to[i].bed
+            || loops[i].needle != input.bed_to[i].needle){
+                stats.error_index = i;
+                return FinalMismatch;
+            }
+        }
+        stats.error_index = -1;
+        return Valid;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_simulation_transfers(){
+        return stats.transfers;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_simulation_passes(){
+        return stats.passes;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_simulation_racking_changes(){
+        return stats.racking_changes;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_simulation_max_racking(){
+        return stats.max_racking;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_simulation_empty_transfers(){
+        return stats.empty_transfers;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    int32_t get_simulation_error_index(){
+        return stats.error_index;
+    }
+
+    // external transfer lists (e.g. post-processed plans) to simulate
+    EMSCRIPTEN_KEEPALIVE
+    void clear_output(uint32_t xfer_count){
+        output.clear();
+        output.reserve(xfer_count);
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void add_transfer(
+        uint8_t from_side, int32_t from_offset,
+        uint8_t to_side, int32_t to_offset){
+        output.emplace_back(
+            BedNeedle(side_to_bed(from_side), from_offset),
+            BedNeedle(side_to_bed(to_side), to_offset)
+        );
+    }
+
     // output reading functions
     EMSCRIPTEN_KEEPALIVE
     uint32_t get_output_size(){
@@ -27,7 +27,7 @@ function needleFrom(str){
     } else {
         if(!Array.isArray(str) || str.length !== 2)
             throw new InvalidArgumentError('Needles must either be strings or arrays of [str, number]');
-        side = str[0].charAt(0).toUpperCase();
+        side = str[0].length === 2 ? str[0].charAt(0).toUpperCase() : str[0];
         offset = str[1];
     }
     if(typeof side !== 'string')
@@ -50,40 +50,63 @@ function knitoutNeedle(side, offset, asArray = false){
     }
 }
 const xfer = Module;
-xfer.plan_transfers = function plan_transfers(from, to, params){
-    if(!from.length)
-        return [];
-    if(from.length !== to.length)
-        throw new InvalidArgumentError('From and to arguments must be arrays of the same length');
-    // default arguments
-    if(!params)
-        params = {};
-    const slack = params.slack || 2;
-    const max_racking = params.max_racking || 4;
+const encoder = new TextEncoder();
 
-    // create input
-    xfer._allocate_input(from.length);
-    for(let i = 0; i < from.length; ++i){
-        const [f_bed, f_off] = needleFrom(from[i]);
-        xfer._set_from_needle(i, f_bed, f_off);
-        const [t_bed, t_off] = needleFrom(to[i]);
-        xfer._set_to_needle(i, t_bed, t_off);
-        // set slack if as an array
-        if(Array.isArray(slack)){
-            const s = slack[i];
-            if(slack.length !== from.length)
-                throw new InvalidArgumentError('Slack array must be the same size as from and to arrays');
-            if(typeof s !== 'number')
-                throw new InvalidArgumentError('Slack must either be an integer, or an array of integers');
-            xfer._set_slack(i, s);
+function checkPackedResult(idx, N){
+    if(idx < 0)
+        return;
+    else if(idx < N)
+        throw new InvalidArgumentError('Invalid from needle #' + idx);
+    else if(idx < 2 * N)
+        throw new InvalidArgumentError('Invalid to needle #' + (idx - N));
+    else
+        throw new InvalidArgumentError('Invalid slack #' + (idx - 2 * N));
+}
+
+function setNeedleInput(from, to){
+    const N = from.length;
+    if(from.every(n => typeof n === 'string') && to.every(n => typeof n === 'string')){
+        // parse all needle names in a single native pass
+        const text = encoder.encode(from.join(' ') + ' ' + to.join(' '));
+        const ptr = xfer._allocate_needle_text(text.length);
+        xfer.HEAPU8.set(text, ptr);
+        const idx = xfer._parse_needle_text(N);
+        if(idx >= 0)
+            throw new InvalidArgumentError('Invalid needle: ' + (idx < N ? from[idx] : to[idx - N]));
+    } else {
+        xfer._allocate_packed_input(N);
+        const fromBeds = new Uint8Array(xfer.HEAPU8.buffer, xfer._get_packed_from_beds(), N);
+        const fromOffsets = new Int32Array(xfer.HEAP32.buffer, xfer._get_packed_from_offsets(), N);
+        const toBeds = new Uint8Array(xfer.HEAPU8.buffer, xfer._get_packed_to_beds(), N);
+        const toOffsets = new Int32Array(xfer.HEAP32.buffer, xfer._get_packed_to_offsets(), N);
+        for(let i = 0; i < N; ++i){
+            [fromBeds[i], fromOffsets[i]] = needleFrom(from[i]);
+            [toBeds[i], toOffsets[i]] = needleFrom(to[i]);
         }
     }
-    if(!Array.isArray(slack)){
+}
+
+function setSlackInput(slack, N){
+    if(Array.isArray(slack) || ArrayBuffer.isView(slack)){
+        if(slack.length !== N)
+            throw new InvalidArgumentError('Slack array must be the same size as from and to arrays');
+        const slacks = new Int32Array(xfer.HEAP32.buffer, xfer._get_packed_slacks(), N);
+        for(let i = 0; i < N; ++i){
+            if(typeof slack[i] !== 'number')
+                throw new InvalidArgumentError('Slack must either be an integer, or an array of integers');
+            slacks[i] = slack[i];
+        }
+        checkPackedResult(xfer._set_packed_input(1), N);
+    } else {
         if(typeof slack !== 'number')
             throw new InvalidArgumentError('Slack must either be an integer, or an array of integers');
+        checkPackedResult(xfer._set_packed_input(0), N);
         xfer._create_default_slack(slack);
     }
-    // set bed constraints
+}
+
+function setConstraints(params){
+    const max_racking = params.max_racking || 4;
     xfer._set_max_racking(max_racking);
     if('min_free' in params || 'max_free' in params){
         const min_free = params.min_free;
@@ -96,6 +119,11 @@ xfer.plan_transfers = function plan_transfers(from, to, params){
     } else {
         xfer._reset_free_range();
     }
+}
+
+function planFromInput(params){
+    // set bed constraints
+    setConstraints(params);
 
     // call wasm code
     const res = xfer._plan_cse_transfers();
@@ -103,20 +131,179 @@ xfer.plan_transfers = function plan_transfers(from, to, params){
         return null;
     } else {
         const needles_as_array = !!params.needles_as_array;
-        const xfers = [];
         // get transfer list
-        const xferCount = xfer._get_output_size();
-        for(let i = 0; i < xferCount; ++i){
-            // get from needle
-            const f_bed = xfer._get_transfer_from_bed(i);
-            const f_off = xfer._get_transfer_from_offset(i);
-            const t_bed = xfer._get_transfer_to_bed(i);
-            const t_off = xfer._get_transfer_to_offset(i);
-            xfers.push([
-                knitoutNeedle(f_bed, f_off, needles_as_array),
-                knitoutNeedle(t_bed, t_off, needles_as_array)
-            ]);
+        return xfer.time_readback(() => {
+            const xfers = [];
+            const xferCount = xfer._get_output_size();
+            for(let i = 0; i < xferCount; ++i){
+                // get from needle
+                const f_bed = xfer._get_transfer_from_bed(i);
+                const f_off = xfer._get_transfer_from_offset(i);
+                const t_bed = xfer._get_transfer_to_bed(i);
+                const t_off = xfer._get_transfer_to_offset(i);
+                xfers.push([
+                    knitoutNeedle(f_bed, f_off, needles_as_array),
+                    knitoutNeedle(t_bed, t_off, needles_as_array)
+                ]);
+            }
+            return xfers;
+        });
+    }
+}
+
+xfer.plan_transfers = function plan_transfers(from, to, params){
+    if(!from.length)
+        return [];
+    if(from.length !== to.length)
+        throw new InvalidArgumentError('From and to arguments must be arrays of the same length');
+    // default arguments
+    if(!params)
+        params = {};
+    const slack = params.slack || 2;
+
+    // record problem
+    if(recording){
+        const args = { slack: typeof slack === 'number' ? slack : Array.from(slack) };
+        for(const key of ['max_racking', 'min_free', 'max_free']){
+            if(key in params)
+                args[key] = params[key];
+        }
+        recording.push({ from: from.slice(), to: to.slice(), params: args });
+    }
+
+    // create input
+    setNeedleInput(from, to);
+    setSlackInput(slack, from.length);
+    return planFromInput(params);
+};
+
+/**
+ * Transfer planning from packed needle arrays
+ *
+ * @param beds { fromBeds, fromOffsets, toBeds, toOffsets } where the beds
+ *        are Uint8Array of side codes ('f', 'F', 'b', 'B' char codes)
+ *        and the offsets are Int32Array
+ * @param params same as plan_transfers (slack can be an Int32Array)
+ */
+xfer.plan_packed_transfers = function plan_packed_transfers({
+    fromBeds, fromOffsets, toBeds, toOffsets
+}, params){
+    const N = fromBeds.length;
+    if(!N)
+        return [];
+    if(fromOffsets.length !== N || toBeds.length !== N || toOffsets.length !== N)
+        throw new InvalidArgumentError('Packed arrays must have the same length');
+    if(!params)
+        params = {};
+    const slack = params.slack || 2;
+
+    // copy packed arrays
+    xfer._allocate_packed_input(N);
+    xfer.HEAPU8.set(fromBeds, xfer._get_packed_from_beds());
+    xfer.HEAP32.set(fromOffsets, xfer._get_packed_from_offsets() >> 2);
+    xfer.HEAPU8.set(toBeds, xfer._get_packed_to_beds());
+    xfer.HEAP32.set(toOffsets, xfer._get_packed_to_offsets() >> 2);
+    setSlackInput(slack, N);
+    return planFromInput(params);
+};
+
+// simulation of transfer plans
+const simulationErrors = [
+    null, 'Invalid transfer', 'Racking limit', 'Slack limit', 'Free range', 'Final mismatch'
+];
+function simulateOutput(){
+    const res = xfer._simulate_transfers();
+    return {
+        valid: res === 0,
+        error: res === 0 ? null : simulationErrors[res] || 'Unknown error',
+        errorIndex: xfer._get_simulation_error_index(),
+        transfers: xfer._get_simulation_transfers(),
+        passes: xfer._get_simulation_passes(),
+        rackingChanges: xfer._get_simulation_racking_changes(),
+        maxRacking: xfer._get_simulation_max_racking(),
+        emptyTransfers: xfer._get_simulation_empty_transfers()
+    };
+}
+
+/**
+ * Replay a transfer list from the from needles and check its validity
+ * (racking and slack limits, free range and final positions)
+ *
+ * @param from the source needles (as for plan_transfers)
+ * @param to the target needles
+ * @param xfers the transfer list [[fromNeedle, toNeedle]]
+ * @param params same as plan_transfers
+ * @return { valid, error, errorIndex, transfers, passes, rackingChanges, maxRacking, emptyTransfers }
+ */
+xfer.simulate_transfers = function simulate_transfers(from, to, xfers, params){
+    if(from.length !== to.length)
+        throw new InvalidArgumentError('From and to arguments must be arrays of the same length');
+    if(!params)
+        params = {};
+    setNeedleInput(from, to);
+    setSlackInput(params.slack || 2, from.length);
+    setConstraints(params);
+    xfer._clear_output(xfers.length);
+    for(const [fn, tn] of xfers){
+        const [f_bed, f_off] = needleFrom(fn);
+        const [t_bed, t_off] = needleFrom(tn);
+        xfer._add_transfer(f_bed, f_off, t_bed, t_off);
+    }
+    return simulateOutput();
+};
+
+// recording of planning problems (to create benchmark corpora)
+let recording = null;
+xfer.start_recording = function start_recording(){
+    recording = [];
+    return recording;
+};
+xfer.stop_recording = function stop_recording(){
+    const list = recording;
+    recording = null;
+    return list;
+};
+
+/**
+ * Plan and simulate a corpus of transfer problems
+ *
+ * @param corpus [{ from, to, params }] (e.g. from start_recording)
+ * @param params parameters overriding the ones of the corpus
+ * @return a report with timing and plan quality metrics
+ */
+xfer.benchmark_transfers = function benchmark_transfers(corpus, params = {}){
+    const now = typeof performance !== 'undefined' ? () => performance.now() : () => Date.now();
+    const report = {
+        problems: corpus.length, planned: 0, valid: 0, failures: [],
+        time: 0, maxTime: 0,
+        transfers: 0, passes: 0, rackingChanges: 0, emptyTransfers: 0
+    };
+    for(let i = 0; i < corpus.length; ++i){
+        const { from, to } = corpus[i];
+        const args = Object.assign({}, corpus[i].params, params);
+        const t0 = now();
+        const xfers = xfer.plan_transfers(from, to, args);
+        const dt = now() - t0;
+        report.time += dt;
+        report.maxTime = Math.max(report.maxTime, dt);
+        if(!xfers){
+            report.failures.push({ index: i, error: 'Planning failed' });
+            continue;
+        }
+        ++report.planned;
+        if(!from.length){
+            ++report.valid;
+            continue;
         }
-        return xfers;
+        const sim = simulateOutput();
+        if(sim.valid)
+            ++report.valid;
+        else
+            report.failures.push({ index: i, error: sim.error, errorIndex: sim.errorIndex });
+        report.transfers += sim.transfers;
+        report.passes += sim.passes;
+        report.rackingChanges += sim.rackingChanges;
+        report.emptyTransfers += sim.emptyTransfers;
     }
+    return report;
 };
\ No newline at end of file
@@ -1,18 +1,30 @@
 #include <emscripten.h>
-#include <emscripten/bind.h> 
 #include "geometrycentral/surface/manifold_surface_mesh.h"
 #include "geometrycentral/utilities/mesh_data.h"
 #include "geometrycentral/surface/edge_length_geometry.h"
 #include "geometrycentral/surface/heat_method_distance.h"
+#include "geometrycentral/surface/intrinsic_mollification.h"
+#include "geometrycentral/surface/tufted_laplacian.h"
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/numerical/linear_solvers.h"
 #include <Eigen/Core>
+#include <Eigen/SparseCholesky>
+#include <math.h>
+#include "multigrid.h"
+#include "../wasm_stats.h"
+#include "../wasm_heap.h"
 #include <stdio.h>
 #include <iostream>
+#include <algorithm>
+#include <array>
 
 using namespace geometrycentral;
 using namespace geometrycentral::surface;
 typedef int iptr_t;
 typedef int dptr_t;
 
+const uint32_t stats_module_id = STATS_GDIST;
+
 // mesh data
 static Eigen::MatrixX3i faces;
 static Eigen::MatrixX3d edges;
@@ -27,24 +39,408 @@ static std::unique_ptr<HeatMethodDistanceSolver> heatSolver;
 
 // the output vertex data
 static VertexData<double> distToSource;
+static Eigen::VectorXf distToSourceF;
+
+// screened Poisson field data (vertex x channel)
+// weights are per-vertex screening weights, with infinity for Dirichlet values
+static Eigen::VectorXd fieldWeights;
+static Eigen::MatrixXd fieldValues;
+static Eigen::MatrixXd fieldSources;
+static Eigen::MatrixXd fieldSolution;
+
+// the field system and its factorization (for the weights it was built with)
+static Eigen::VectorXd factoredWeights;
+static SparseMatrix<double> fieldMatrix;
+static BlockDecompositionResult<double> fieldBlocks;
+static std::unique_ptr<Eigen::SimplicialLDLT<SparseMatrix<double>>> fieldSolver;
+static size_t numDirichlet = 0;
+
+// multigrid hierarchy (level 0 is the coarsest, the last level is the mesh)
+static std::vector<std::vector<Eigen::Triplet<double>>> levelEntries;
+static std::vector<SpMat> levelProlongations;
+static SpMat mgLaplacian;
+static Eigen::VectorXd mgMass;
+static double mgMeanEdge = 1.0;
+static Multigrid heatMG;
+static Multigrid poissonMG;
+static MixedMultigrid heatMixed;
+static MixedMultigrid poissonMixed;
+static Eigen::MatrixX3f edgesF;
+static Eigen::VectorXf mgHeatF;
+static Eigen::VectorXf mgDivergenceF;
+static Multigrid fieldMG;
+static Eigen::VectorXd mgFactoredWeights;
+static Eigen::VectorXd mgHeat;
+static Eigen::VectorXd mgDivergence;
+static Eigen::VectorXd mgPotential; // unshifted Poisson solution
+static Eigen::VectorXd mgDistance;
+static Eigen::VectorXf mgDistanceF;
+static double mgTolerance = 1e-8;
+// /!\ the heat source is a unit impulse, so its residual is absolute,
+//     and it must get below the far-field heat, which decays exponentially
+//     (the distances there come from the normalized gradient of tiny values)
+static double mgHeatTolerance = 1e-24;
+static size_t mgMaxIterations = 200;
+static size_t mgIterations = 0;
+
+// iterative solvers without hierarchy
+static IncompleteCholeskyCG heatIC;
+static IncompleteCholeskyCG poissonIC;
+
+// iterative statistics of the last source
+static size_t heatIterations = 0;
+static size_t poissonIterations = 0;
+
+// locality-preserving source order
+static Eigen::VectorXi sourceOrder;
+
+// robust direct solves with the operators of the intrinsic Delaunay
+// triangulation (tufted cover of the mollified mesh), which is cached
+// with the hash of the mesh it was built from, so that re-precomputing
+// the same mesh (e.g. with another time step) does not rebuild it
+static uint64_t intrinsicHash = 0;
+static Eigen::MatrixX3i intrinsicFaces;
+static Eigen::MatrixX3d intrinsicEdges;
+static SpMat intrinsicLaplacian;
+static Eigen::VectorXd intrinsicMass;
+static double intrinsicMeanEdge = 1.0; // of the input mesh (as the time step)
+static double intrinsicTimeStep = 0;   // time step of heatDirect
+static DirectCholesky heatDirect;
+static DirectCholesky poissonDirect;   // independent of the time step
+static bool useIntrinsic = false;      // whether the last precompute was robust
 
 // parameters
 static double timeStep = 1.0;
 static bool robust = false;
+static bool intrinsicCache = false; // robust solves with the cached triangulation
+static bool useFloat32 = false; // single-precision solves and outputs
+static bool warmStart = true;   // iterative Poisson solves start from the last source
 static bool verbose = true;
 
-std::string getExceptionMessage(intptr_t exceptionPtr) {
-    return std::string(reinterpret_cast<std::exception *>(exceptionPtr)->what());
+// message of the last error (see get_error_message)
+static char errorMessage[256] = "";
+
+// validation buffers, reused across meshes
+static std::vector<std::array<int, 3>> corners;
+static std::vector<uint64_t> halfedges;
+
+template <typename... Args>
+static int set_error(int code, const char *format, Args... args){
+  snprintf(errorMessage, sizeof(errorMessage), format, args...);
+  if(verbose)
+    printf("%s\n", errorMessage);
+  return code;
 }
 
-EMSCRIPTEN_BINDINGS(Bindings) {
-  emscripten::function("getExceptionMessage", &getExceptionMessage);
-};
+/**
+ * Check that the faces describe a manifold triangle mesh,
+ * since the mesh construction cannot report errors otherwise.
+ *
+ * Returns 0 if valid, -1 for invalid faces, -2 for a non-manifold mesh.
+ */
+static int validate_faces(){
+  const size_t F = faces.rows();
+  if(F == 0)
+    return set_error(-1, "No face");
+  if(faces.minCoeff() < 0)
+    return set_error(-1, "Negative vertex index");
+  const size_t V = faces.maxCoeff() + 1;
+
+  // corners (v, next, prev) sorted by vertex
+  corners.clear();
+  corners.reserve(F * 3);
+  halfedges.clear();
+  halfedges.reserve(F * 3);
+  for(size_t f = 0; f < F; ++f){
+    for(int i = 0; i < 3; ++i){
+      const int v = faces(f, i);
+      const int n = faces(f, (i + 1) % 3);
+      const int p = faces(f, (i + 2) % 3);
+      if(v == n)
+        return set_error(-1, "Face #%zu has repeated vertices", f);
+      corners.push_back({ v, n, p });
+      halfedges.push_back(uint64_t(v) * V + uint64_t(n));
+    }
+  }
+
+  // each half-edge once (else an edge has more than two faces
+  // or inconsistent orientations)
+  std::sort(halfedges.begin(), halfedges.end());
+  const auto dup = std::adjacent_find(halfedges.begin(), halfedges.end());
+  if(dup != halfedges.end())
+    return set_error(-2, "Non-manifold edge (%d, %d)", int(*dup / V), int(*dup % V));
+
+  // each vertex is referenced, with its faces forming a single fan
+  // /!\ the fan links (next -> prev) have in and out degrees of at most one
+  //     since the half-edges are unique, so they form paths and cycles
+  std::sort(corners.begin(), corners.end());
+  size_t c = 0;
+  for(size_t v = 0; v < V; ++v){
+    const size_t begin = c;
+    while(c < corners.size() && size_t(corners[c][0]) == v)
+      ++c;
+    const size_t links = c - begin;
+    if(!links)
+      return set_error(-1, "Vertex #%zu is not referenced", v);
+    // start from the fan boundary if any
+    size_t start = begin;
+    for(size_t i = begin; i < c; ++i){
+      bool has_prev = false;
+      for(size_t j = begin; j < c; ++j)
+        has_prev |= corners[j][2] == corners[i][1];
+      if(!has_prev){
+        start = i;
+        break;
+      }
+    }
+    // walk the fan
+    size_t visited = 1;
+    for(size_t i = start; visited < links; ++visited){
+      size_t next = c;
+      for(size_t j = begin; j < c; ++j){
+        if(corners[j][1] == corners[i][2]){
+          next = j;
+          break;
+        }
+      }
+      if(next == c || next == start)
+        break;
+      i = next;
+    }
+    if(visited != links)
+      return set_error(-2, "Non-manifold vertex #%zu", v);
+  }
+  return 0;
+}
+
+/**
+ * Build the heat method operators over the current faces and edge lengths
+ *
+ *    heat:    M + t L      with t = timeStep * h^2
+ *    Poisson: L + eps M    (shifted to be definite)
+ */
+static SpMat lumped_mass_matrix(const Eigen::VectorXd &mass){
+  const size_t V = mass.size();
+  SpMat M(V, V);
+  M.reserve(Eigen::VectorXi::Constant(V, 1));
+  for(size_t i = 0; i < V; ++i)
+    M.insert(i, i) = mass[i];
+  return M;
+}
+
+static void build_heat_operators(SpMat &heatOp, SpMat &poissonOp){
+  const size_t V = faces.maxCoeff() + 1;
+  mgMeanEdge = build_cotan_laplacian(faces, edges, V, mgLaplacian, mgMass);
+  const SpMat M = lumped_mass_matrix(mgMass);
+  const double t = timeStep * mgMeanEdge * mgMeanEdge;
+  heatOp = M + t * mgLaplacian;
+  // /!\ small mass shift to make the Poisson problem definite
+  poissonOp = mgLaplacian + (1e-6 / (mgMeanEdge * mgMeanEdge)) * M;
+
+  // previous fields cannot be used as initial guesses anymore
+  mgHeat.resize(0);
+  mgPotential.resize(0);
+}
+
+/**
+ * Initial guess of an iterative solve: the previous solution if warm starts
+ * are enabled and it has a lower residual than zero, else zero.
+ */
+template <typename Solver>
+static void initial_guess(const Solver &solver, const Eigen::VectorXd &b, Eigen::VectorXd &x){
+  if(!warmStart || x.size() != b.size()){
+    x.setZero(b.size());
+    if(warmStart)
+      stats_cache(false); // no previous field
+    return;
+  }
+  const bool better = (b - solver.matrix() * x).squaredNorm() < b.squaredNorm();
+  stats_cache(better);
+  if(!better)
+    x.setZero();
+}
+
+/**
+ * Heat method distance with iterative solvers,
+ * where the Poisson solve is warm-started from the previous potential,
+ * or with direct solvers (e.g. of the intrinsic triangulation).
+ * The gradient and divergence are always taken over the input mesh,
+ * as in the robust mode of HeatMethodDistanceSolver.
+ * In float32 mode, the result is converted to a float32 buffer.
+ */
+template <typename Solver>
+static dptr_t solve_heat_distance(Solver &heat, Solver &poisson, size_t srcIndex){
+  const bool direct = std::is_same<Solver, DirectCholesky>::value;
+  const size_t V = heat.matrix().rows();
+  Eigen::VectorXd rhs = Eigen::VectorXd::Zero(V);
+  rhs[srcIndex] = 1.0;
+
+  // 1 = heat diffusion
+  // /!\ always from zero, since the heat of another source is mostly
+  //     a worse guess than zero in the far field, where the tolerance is set
+  mgHeat.setZero(V);
+  heat.solve(rhs, mgHeat, mgHeatTolerance, mgMaxIterations);
+  heatIterations = heat.iterations;
+
+  // 2 = normalized gradient and its divergence
+  if(std::is_same<Solver, MixedMultigrid>::value){
+    mgHeatF = mgHeat.cast<float>();
+    normalized_gradient_divergence(faces, edgesF, mgHeatF, mgDivergenceF);
+    mgDivergence = mgDivergenceF.cast<double>();
+  } else {
+    normalized_gradient_divergence(faces, edges, mgHeat, mgDivergence);
+  }
+
+  // 3 = Poisson (L is positive, hence the sign)
+  rhs = -mgDivergence;
+  // /!\ the potential is kept unshifted, since a constant offset
+  //     is nearly in the null space and slow to remove for the warm start
+  if(!direct)
+    initial_guess(poisson, rhs, mgPotential);
+  poisson.solve(rhs, mgPotential, mgTolerance, mgMaxIterations);
+  poissonIterations = poisson.iterations;
+  mgIterations = heatIterations + poissonIterations;
+  mgDistance = mgPotential.array() - mgPotential[srcIndex];
+  if(verbose && !direct)
+    printf("Iterative distance after %zu + %zu iterations\n",
+      heatIterations, poissonIterations);
+
+  if(useFloat32){
+    mgDistanceF = mgDistance.cast<float>();
+    return reinterpret_cast<dptr_t>(mgDistanceF.data());
+  }
+  return reinterpret_cast<dptr_t>(mgDistance.data());
+}
+
+// hash of the faces and edge lengths (FNV-1a)
+static uint64_t mesh_hash(){
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const auto add = [&hash](const void *data, size_t size){
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    for(size_t i = 0; i < size; ++i){
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+  };
+  add(faces.data(), faces.size() * sizeof(int));
+  add(edges.data(), edges.size() * sizeof(double));
+  return hash;
+}
+
+/**
+ * Precompute the robust direct solvers over the intrinsic triangulation.
+ * The triangulation and its Poisson factorization are only rebuilt
+ * if the mesh changed, and the heat factorization if the time step changed.
+ * As in HeatMethodDistanceSolver, the time step and Poisson shift
+ * are scaled by the mean edge length of the input mesh, not of the cover.
+ *
+ * Returns 0 on success, -2 if a factorization failed.
+ */
+static int precompute_intrinsic(){
+  const uint64_t hash = mesh_hash();
+  const bool hit = hash == intrinsicHash && poissonDirect.ready();
+  stats_cache(hit);
+  if(!hit){
+    const double start = emscripten_get_now();
+    intrinsicHash = 0;
+    heatDirect.clear();
+    poissonDirect.clear();
+
+    // tufted cover of the mollified mesh, flipped to intrinsic Delaunay
+    // (as in the robust mode of HeatMethodDistanceSolver)
+    std::unique_ptr<SurfaceMesh> tuftedMesh = mesh->copyToSurfaceMesh();
+    EdgeData<double> tuftedLengths = edgeLengths.reinterpretTo(*tuftedMesh);
+    mollifyIntrinsic(*tuftedMesh, tuftedLengths, 1e-6);
+    buildIntrinsicTuftedCover(*tuftedMesh, tuftedLengths);
+    flipToDelaunay(*tuftedMesh, tuftedLengths);
+
+    // faces and edge lengths of the triangulation (over the mesh vertices)
+    intrinsicFaces.resize(tuftedMesh->nFaces(), 3);
+    intrinsicEdges.resize(tuftedMesh->nFaces(), 3);
+    size_t i = 0;
+    for(Face f : tuftedMesh->faces()){
+      Halfedge he = f.halfedge();
+      for(int k = 0; k < 3; ++k, he = he.next()){
+        intrinsicFaces(i, k) = he.vertex().getIndex();
+        intrinsicEdges(i, k) = tuftedLengths[he.edge()];
+      }
+      ++i;
+    }
+    build_cotan_laplacian(
+      intrinsicFaces, intrinsicEdges, mesh->nVertices(),
+      intrinsicLaplacian, intrinsicMass
+    );
+    intrinsicMeanEdge = edgeLengths.raw().mean();
+
+    // Poisson factorization (see build_heat_operators)
+    const double h2 = intrinsicMeanEdge * intrinsicMeanEdge;
+    const SpMat M = lumped_mass_matrix(intrinsicMass);
+    if(!poissonDirect.setup(intrinsicLaplacian + (1e-6 / h2) * M))
+      return set_error(-2, "Poisson factorization failed");
+    intrinsicHash = hash;
+    module_stats.cache_build_time += emscripten_get_now() - start;
+    if(verbose)
+      printf("Intrinsic triangulation with %zu faces\n", i);
+  }
+
+  // heat factorization for the current time step
+  if(!heatDirect.ready() || intrinsicTimeStep != timeStep){
+    const double t = timeStep * intrinsicMeanEdge * intrinsicMeanEdge;
+    const SpMat M = lumped_mass_matrix(intrinsicMass);
+    if(!heatDirect.setup(M + t * intrinsicLaplacian))
+      return set_error(-2, "Heat factorization failed");
+    intrinsicTimeStep = timeStep;
+  }
+  return 0;
+}
 
 extern "C" {
 
+  /**
+   * Heap bytes needed by a mesh with the direct backend
+   * (see reserve in wasm_heap.h), which bounds the iterative ones.
+   *
+   * The factorizations are estimated with a fixed fill-in
+   * of the (reordered) Laplacian, which is typical for surface meshes.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  size_t plan_capacity(size_t num_faces, size_t num_vertices){
+    const size_t F = num_faces;
+    const size_t V = num_vertices;
+    const size_t H = 3 * F; // half-edges (and corners)
+    const size_t E = H / 2 + 1;
+    const size_t CHOLESKY_FILL = 8;
+    // mesh data and validation
+    size_t bytes = vector_bytes<int>(H)
+                 + vector_bytes<double>(H)
+                 + vector_bytes<float>(H)
+                 + vector_bytes<std::array<int, 3>>(H)
+                 + vector_bytes<uint64_t>(H);
+    // mesh connectivity (per half-edge, vertex, edge and face)
+    bytes += 4 * vector_bytes<size_t>(H)
+           + 2 * vector_bytes<size_t>(V)
+           + 2 * vector_bytes<size_t>(E)
+           + vector_bytes<size_t>(F);
+    // geometry quantities (edge lengths, angles, cotan weights, areas)
+    bytes += vector_bytes<double>(E)
+           + 3 * vector_bytes<double>(H)
+           + vector_bytes<double>(F)
+           + 2 * vector_bytes<double>(V);
+    // Laplacian and mass matrices, and the two factorizations
+    const size_t nnz = V + 2 * E;
+    const size_t entry = sizeof(double) + sizeof(int);
+    bytes += 2 * nnz * entry + 2 * vector_bytes<int>(V + 1)
+           + 2 * CHOLESKY_FILL * nnz * entry;
+    // intrinsic triangulation of the robust mode (tufted cover, twice the faces)
+    bytes += vector_bytes<int>(2 * H) + vector_bytes<double>(2 * H);
+    // outputs
+    bytes += vector_bytes<double>(V) + vector_bytes<float>(V);
+    return bytes;
+  }
+
   EMSCRIPTEN_KEEPALIVE
   iptr_t allocate_faces(size_t num_faces){
+    StatsPhaseTimer timer(PHASE_SETUP);
     faces.resize(num_faces, 3);
     edges.resize(num_faces, 3);
     return reinterpret_cast<iptr_t>(&faces(0, 0));
@@ -76,6 +472,7 @@ extern "C" {
 
   EMSCRIPTEN_KEEPALIVE
   iptr_t allocate_edges(size_t num_edges){
+    StatsPhaseTimer timer(PHASE_SETUP);
     edges.resize(num_edges, 3);
     return reinterpret_cast<iptr_t>(&edges(0, 0));
   }
@@ -96,18 +493,79 @@ extern "C" {
   void set_robust(bool flag){
     robust = flag;
   }
+  EMSCRIPTEN_KEEPALIVE
+  void set_intrinsic_cache(bool flag){
+    intrinsicCache = flag;
+  }
+
+  EMSCRIPTEN_KEEPALIVE
+  void set_float32(bool flag){
+    useFloat32 = flag;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  bool get_float32(){
+    return useFloat32;
+  }
+
+  EMSCRIPTEN_KEEPALIVE
+  iptr_t get_error_message(){
+    return reinterpret_cast<iptr_t>(errorMessage);
+  }
 
+  /**
+   * Create the mesh topology from the faces.
+   *
+   * Returns 0 on success, -1 for invalid faces, -2 for a non-manifold mesh.
+   */
   EMSCRIPTEN_KEEPALIVE
-  void create_surface_mesh(){
+  int create_surface_mesh(){
+    StatsPhaseTimer timer(PHASE_SETUP);
+    mesh.reset();
+    geometry.reset();
+    heatSolver.reset();
+    useIntrinsic = false;
+    const int rc = validate_faces();
+    if(rc)
+      return rc;
+
     // create underlying mesh topology
     mesh.reset(new ManifoldSurfaceMesh(faces));
     mesh->compress();
     if(verbose)
       mesh->printStatistics();
+    return 0;
   }
 
+  /**
+   * Precompute the heat method over the mesh and edge lengths.
+   * In robust mode with the intrinsic cache, the intrinsic triangulation
+   * is reused while the mesh does not change (see precompute_intrinsic).
+   * /!\ the cache is opt-in until compared against the robust
+   *     HeatMethodDistanceSolver on production meshes (see test3.js)
+   *
+   * Returns 0 on success, -1 without mesh, -2 for invalid edge lengths
+   * (non-positive, or violating the triangle inequality unless robust)
+   * or if a factorization failed.
+   */
   EMSCRIPTEN_KEEPALIVE 
-  void precompute(){
+  int precompute(){
+    StatsPhaseTimer timer(PHASE_PRECOMPUTE);
+    if(!mesh)
+      return set_error(-1, "No mesh");
+    heatSolver.reset();
+    useIntrinsic = false;
+
+    // check edge lengths
+    // /!\ the factorizations would fail without reporting it
+    for(Eigen::Index i = 0; i < faces.rows(); ++i){
+      const double a = edges(i, 0);
+      const double b = edges(i, 1);
+      const double c = edges(i, 2);
+      if(!(a > 0 && b > 0 && c > 0) || !std::isfinite(a + b + c))
+        return set_error(-2, "Invalid edge lengths of face #%td", i);
+      if(!robust && (a >= b + c || b >= a + c || c >= a + b))
+        return set_error(-2, "Degenerate face #%td (use robust mode)", i);
+    }
 
     // create implicit geometry using edge lengths and mesh
     edgeLengths = EdgeData<double>(*mesh);
@@ -115,10 +573,8 @@ extern "C" {
       if(verbose)
         printf("Setting lengths of face #%zu\n", i);
       Face f = mesh->face(i);
-      if(!f.isTriangle()){
-        printf("Face is not a triangle\n");
-        return;
-      }
+      if(!f.isTriangle())
+        return set_error(-1, "Face #%zu is not a triangle", i);
       Halfedge he = f.halfedge(); edgeLengths[he.edge()] = edges(i, 0);
       he = he.next(); edgeLengths[he.edge()] = edges(i, 1);
       he = he.next(); edgeLengths[he.edge()] = edges(i, 2);
@@ -131,21 +587,466 @@ extern "C" {
     }
     geometry.reset(new EdgeLengthGeometry(*mesh, edgeLengths));
 
-    // create heat method distance solver (precomputation happens here)
-    heatSolver.reset(new HeatMethodDistanceSolver(*geometry, timeStep, robust));
+    // robust solvers over the cached intrinsic triangulation,
+    // else heat method distance solver (precomputation happens here)
+    if(robust && intrinsicCache){
+      const int rc = precompute_intrinsic();
+      if(rc)
+        return rc;
+      useIntrinsic = true;
+    } else {
+      heatSolver.reset(new HeatMethodDistanceSolver(*geometry, timeStep, robust));
+    }
+
+    // invalidate field factorization
+    fieldSolver.reset();
+    factoredWeights.resize(0);
+    return 0;
   }
 
+  // returns the distances, or null without precomputation
   EMSCRIPTEN_KEEPALIVE
   dptr_t compute_from_source(size_t srcIndex){
+    StatsPhaseTimer timer(PHASE_SOLVE, true);
+    if(!(heatSolver || useIntrinsic) || srcIndex >= mesh->nVertices())
+      return set_error(0, "Invalid source #%zu or no precomputation", srcIndex);
+    if(useIntrinsic)
+      return solve_heat_distance(heatDirect, poissonDirect, srcIndex);
     const Vertex v = mesh->vertex(srcIndex);
     distToSource = heatSolver->computeDistance(v);
 
     if(verbose)
       printf("Returning result pointer\n");
 
+    // /!\ the direct solver is double-only, so only the output is converted
+    if(useFloat32){
+      distToSourceF = distToSource.raw().cast<float>();
+      return reinterpret_cast<dptr_t>(distToSourceF.data());
+    }
     Eigen::VectorXd &mat = distToSource.raw();
     double* ptr = &mat(0, 0);
     return reinterpret_cast<dptr_t>(ptr);
   }
 
-}
\ No newline at end of file
+  // heap bytes needed by a field solve (see plan_capacity)
+  EMSCRIPTEN_KEEPALIVE
+  size_t plan_field_capacity(size_t num_channels){
+    const size_t V = faces.rows() ? faces.maxCoeff() + 1 : 0;
+    const size_t nnz = V + 3 * faces.rows();
+    const size_t entry = sizeof(double) + sizeof(int);
+    const size_t CHOLESKY_FILL = 8;
+    return (1 + 3 * num_channels) * vector_bytes<double>(V)
+         + 2 * vector_bytes<double>(V) // solve temporaries
+         + 2 * nnz * entry + CHOLESKY_FILL * nnz * entry;
+  }
+
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t allocate_field(size_t num_channels){
+    StatsPhaseTimer timer(PHASE_SETUP);
+    const size_t V = faces.rows() ? faces.maxCoeff() + 1 : 0;
+    fieldWeights.setZero(V);
+    fieldValues.setZero(V, num_channels);
+    fieldSources.setZero(V, num_channels);
+    fieldSolution.setZero(V, num_channels);
+    return reinterpret_cast<dptr_t>(fieldWeights.data());
+  }
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t get_field_weight_ptr(){
+    return reinterpret_cast<dptr_t>(fieldWeights.data());
+  }
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t get_field_value_ptr(){
+    return reinterpret_cast<dptr_t>(fieldValues.data());
+  }
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t get_field_source_ptr(){
+    return reinterpret_cast<dptr_t>(fieldSources.data());
+  }
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t get_field_solution_ptr(){
+    return reinterpret_cast<dptr_t>(fieldSolution.data());
+  }
+
+  /**
+   * Build and factor the screened Laplacian system
+   *
+   *    (L + M W) u = M (W c + f)
+   *
+   * where L is the cotan Laplacian, M the lumped mass matrix,
+   * W the finite vertex weights, c the vertex values and f the sources.
+   * Vertices with infinite weight are Dirichlet constraints u = c.
+   *
+   * The factorization is kept until the weights or the mesh change.
+   */
+  bool factor_field(){
+    if(factoredWeights.size() == fieldWeights.size()
+    && factoredWeights == fieldWeights
+    && fieldSolver)
+      return true; // reuse factorization
+
+    const size_t V = mesh->nVertices();
+    geometry->requireCotanLaplacian();
+    geometry->requireVertexDualAreas();
+    const Eigen::VectorXd &area = geometry->vertexDualAreas.raw();
+
+    // screened matrix
+    Vector<bool> isFree(V);
+    Eigen::VectorXd screening = Eigen::VectorXd::Zero(V);
+    numDirichlet = 0;
+    for(size_t i = 0; i < V; ++i){
+      isFree[i] = std::isfinite(fieldWeights[i]);
+      if(isFree[i])
+        screening[i] = area[i] * std::max(0.0, fieldWeights[i]);
+      else
+        ++numDirichlet;
+    }
+    if(numDirichlet == 0 && screening.sum() <= 0){
+      set_error(-2, "Field system is singular: no constraint and no screening");
+      return false;
+    }
+    SparseMatrix<double> S(V, V);
+    S.reserve(Eigen::VectorXi::Constant(V, 1));
+    for(size_t i = 0; i < V; ++i)
+      S.insert(i, i) = screening[i];
+    fieldMatrix = geometry->cotanLaplacian + S;
+
+    // factor free block
+    fieldSolver.reset(new Eigen::SimplicialLDLT<SparseMatrix<double>>());
+    if(numDirichlet){
+      fieldBlocks = decomposeMatrix(fieldMatrix, isFree);
+      fieldSolver->compute(fieldBlocks.AA);
+    } else {
+      fieldSolver->compute(fieldMatrix);
+    }
+    if(fieldSolver->info() != Eigen::Success){
+      fieldSolver.reset();
+      set_error(-2, "Field factorization failed");
+      return false;
+    }
+    factoredWeights = fieldWeights;
+    if(verbose)
+      printf("Factored field system with %zu Dirichlet vertices\n", numDirichlet);
+    return true;
+  }
+
+  /**
+   * Solve the screened Poisson system for each field channel.
+   * With normalize, the per-vertex channel vectors are normalized,
+   * which turns the solve into a direction field smoothing
+   * (for directions in a common frame).
+   *
+   * Returns 0 on success, -1 without mesh, -2 for a singular system.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  int solve_field(bool normalize = false){
+    StatsPhaseTimer timer(PHASE_SOLVE, true);
+    if(!mesh || !geometry)
+      return set_error(-1, "No precomputation");
+    if(!factor_field())
+      return -2;
+
+    const size_t V = mesh->nVertices();
+    const Eigen::VectorXd &area = geometry->vertexDualAreas.raw();
+    for(Eigen::Index c = 0; c < fieldValues.cols(); ++c){
+      // right-hand side
+      Vector<double> rhs(V);
+      for(size_t i = 0; i < V; ++i){
+        const double w = fieldWeights[i];
+        const double sw = std::isfinite(w) ? std::max(0.0, w) : 0.0;
+        rhs[i] = area[i] * (sw * fieldValues(i, c) + fieldSources(i, c));
+      }
+      if(numDirichlet){
+        Vector<double> rhsA, rhsB;
+        decomposeVector(fieldBlocks, rhs, rhsA, rhsB);
+        Vector<double> valA, valB;
+        decomposeVector(fieldBlocks, Vector<double>(fieldValues.col(c)), valA, valB);
+        Vector<double> solA = fieldSolver->solve(rhsA - fieldBlocks.AB * valB);
+        fieldSolution.col(c) = reassembleVector(fieldBlocks, solA, valB);
+      } else {
+        fieldSolution.col(c) = fieldSolver->solve(rhs);
+      }
+    }
+
+    // direction field
+    if(normalize){
+      for(size_t i = 0; i < V; ++i){
+        const double len = fieldSolution.row(i).norm();
+        if(len > 1e-12)
+          fieldSolution.row(i) /= len;
+      }
+    }
+    return 0;
+  }
+
+  EMSCRIPTEN_KEEPALIVE
+  void set_mg_tolerance(double tol){
+    mgTolerance = tol;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  void set_mg_heat_tolerance(double tol){
+    mgHeatTolerance = tol;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  void set_mg_max_iterations(size_t n){
+    mgMaxIterations = n;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  size_t get_mg_iterations(){
+    return mgIterations;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  size_t get_heat_iterations(){
+    return heatIterations;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  size_t get_poisson_iterations(){
+    return poissonIterations;
+  }
+  EMSCRIPTEN_KEEPALIVE
+  void set_warm_start(bool flag){
+    warmStart = flag;
+  }
+
+  /**
+   * Compute a source order where consecutive sources are mostly neighbors,
+   * using a depth-first traversal of the vertex graph from a start vertex
+   * (other components follow in index order).
+   *
+   * @return a pointer to the V vertex indices
+   */
+  EMSCRIPTEN_KEEPALIVE
+  iptr_t compute_source_order(size_t start){
+    const size_t V = faces.rows() ? faces.maxCoeff() + 1 : 0;
+    std::vector<std::vector<int>> neighbors(V);
+    for(Eigen::Index f = 0; f < faces.rows(); ++f){
+      for(int k = 0; k < 3; ++k){
+        const int i = faces(f, k), j = faces(f, (k + 1) % 3);
+        neighbors[i].push_back(j);
+        neighbors[j].push_back(i);
+      }
+    }
+    sourceOrder.resize(V);
+    std::vector<bool> visited(V, false);
+    std::vector<int> stack;
+    size_t n = 0;
+    for(size_t r = 0; r < V; ++r){
+      const int root = (start + r) % V;
+      if(visited[root])
+        continue;
+      stack.push_back(root);
+      while(!stack.empty()){
+        const int i = stack.back();
+        stack.pop_back();
+        if(visited[i])
+          continue;
+        visited[i] = true;
+        sourceOrder[n++] = i;
+        // reverse order so that the first neighbor is visited next
+        for(auto it = neighbors[i].rbegin(); it != neighbors[i].rend(); ++it){
+          if(!visited[*it])
+            stack.push_back(*it);
+        }
+      }
+    }
+    return reinterpret_cast<iptr_t>(sourceOrder.data());
+  }
+
+  // hierarchy with num_levels levels, including the mesh as finest level
+  EMSCRIPTEN_KEEPALIVE
+  void allocate_levels(size_t num_levels){
+    levelEntries.assign(num_levels > 0 ? num_levels - 1 : 0, {});
+    levelProlongations.assign(levelEntries.size(), SpMat());
+  }
+  // prolongation from level-1 to level
+  EMSCRIPTEN_KEEPALIVE
+  void allocate_prolongation(size_t level, size_t num_fine, size_t num_coarse, size_t num_entries){
+    levelEntries[level - 1].clear();
+    levelEntries[level - 1].reserve(num_entries);
+    levelProlongations[level - 1].resize(num_fine, num_coarse);
+  }
+  EMSCRIPTEN_KEEPALIVE
+  void set_prolongation_entry(size_t level, size_t fine, size_t coarse, double weight){
+    levelEntries[level - 1].emplace_back(fine, coarse, weight);
+  }
+
+  /**
+   * Setup the multigrid solvers of the heat method
+   * over the current faces and edge lengths (the finest level).
+   * Only the coarsest level is factored directly.
+   *
+   * Returns 0 on success, -1 for an invalid hierarchy, -2 if factoring failed.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  int precompute_multigrid(){
+    StatsPhaseTimer timer(PHASE_PRECOMPUTE);
+    if(faces.rows() == 0 || levelProlongations.empty())
+      return -1;
+    const size_t V = faces.maxCoeff() + 1;
+    for(size_t l = 0; l < levelProlongations.size(); ++l){
+      SpMat &P = levelProlongations[l];
+      const size_t rows = l + 1 < levelProlongations.size()
+                        ? levelProlongations[l + 1].cols() : V;
+      if(static_cast<size_t>(P.rows()) != rows){
+        printf("Invalid prolongation size at level %zu\n", l + 1);
+        return -1;
+      }
+      P.setFromTriplets(levelEntries[l].begin(), levelEntries[l].end());
+    }
+
+    // operators of the heat method
+    SpMat heatOp, poissonOp;
+    build_heat_operators(heatOp, poissonOp);
+    heatMG.clear();
+    poissonMG.clear();
+    heatMixed.clear();
+    poissonMixed.clear();
+    heatIC.clear();
+    poissonIC.clear();
+    if(useFloat32){
+      // single-precision hierarchy with double-precision refinement
+      edgesF = edges.cast<float>();
+      if(!heatMixed.setup(heatOp, levelProlongations)
+      || !poissonMixed.setup(poissonOp, levelProlongations))
+        return -2;
+    } else if(!heatMG.setup(heatOp, levelProlongations)
+           || !poissonMG.setup(poissonOp, levelProlongations)){
+      return -2;
+    }
+    fieldMG.clear();
+    mgFactoredWeights.resize(0);
+    if(verbose)
+      printf("Multigrid with %zu levels over %zu vertices (%s)\n",
+        levelProlongations.size() + 1, V, useFloat32 ? "float32" : "float64");
+    return 0;
+  }
+
+  /**
+   * Heat method distance with the multigrid solvers,
+   * where the Poisson solve is warm-started from the previous source
+   * (see set_warm_start).
+   *
+   * In float32 mode, both solves use mixed-precision iterative refinement,
+   * the gradient normalization happens in single precision,
+   * and the distances are returned as a float32 buffer.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t compute_from_source_mg(size_t srcIndex){
+    StatsPhaseTimer timer(PHASE_SOLVE, true);
+    if(heatMixed.ready())
+      return solve_heat_distance(heatMixed, poissonMixed, srcIndex);
+    else
+      return solve_heat_distance(heatMG, poissonMG, srcIndex);
+  }
+
+  /**
+   * Setup incomplete Cholesky preconditioned CG solvers of the heat method
+   * over the current faces and edge lengths (no hierarchy needed).
+   *
+   * Returns 0 on success, -1 without mesh, -2 if factoring failed.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  int precompute_iterative(){
+    StatsPhaseTimer timer(PHASE_PRECOMPUTE);
+    if(faces.rows() == 0)
+      return -1;
+    SpMat heatOp, poissonOp;
+    build_heat_operators(heatOp, poissonOp);
+    heatMG.clear();
+    poissonMG.clear();
+    heatMixed.clear();
+    poissonMixed.clear();
+    if(!heatIC.setup(heatOp) || !poissonIC.setup(poissonOp))
+      return -2;
+    if(verbose)
+      printf("Iterative solvers over %zu vertices\n", size_t(mgMass.size()));
+    return 0;
+  }
+
+  EMSCRIPTEN_KEEPALIVE
+  dptr_t compute_from_source_iterative(size_t srcIndex){
+    StatsPhaseTimer timer(PHASE_SOLVE, true);
+    return solve_heat_distance(heatIC, poissonIC, srcIndex);
+  }
+
+  /**
+   * Multigrid variant of solve_field (see above) over the hierarchy,
+   * with the Dirichlet vertices eliminated from the finest level.
+   *
+   * Returns 0 on success, -1 without hierarchy, -2 for a singular system.
+   */
+  EMSCRIPTEN_KEEPALIVE
+  int solve_field_mg(bool normalize = false){
+    StatsPhaseTimer timer(PHASE_SOLVE, true);
+    if(!heatMG.ready() && !heatMixed.ready())
+      return -1;
+    const size_t V = mgMass.size();
+
+    // free vertex selection
+    std::vector<Eigen::Triplet<double>> sel;
+    std::vector<bool> isFree(V);
+    for(size_t i = 0; i < V; ++i){
+      isFree[i] = std::isfinite(fieldWeights[i]);
+      if(isFree[i])
+        sel.emplace_back(i, sel.size(), 1.0);
+    }
+    const size_t numFree = sel.size();
+    SpMat S(V, numFree);
+    S.setFromTriplets(sel.begin(), sel.end());
+
+    // screened system
+    Eigen::VectorXd screening = Eigen::VectorXd::Zero(V);
+    for(size_t i = 0; i < V; ++i){
+      if(isFree[i])
+        screening[i] = mgMass[i] * std::max(0.0, fieldWeights[i]);
+    }
+    if(numFree == V && screening.sum() <= 0)
+      return -2;
+    SpMat A = mgLaplacian;
+    for(size_t i = 0; i < V; ++i)
+      A.coeffRef(i, i) += screening[i];
+    const SpMat St = S.transpose();
+    const SpMat AF = St * A;
+
+    // hierarchy over the free vertices (refactored when the weights change)
+    if(mgFactoredWeights.size() != fieldWeights.size()
+    || mgFactoredWeights != fieldWeights
+    || !fieldMG.ready()){
+      std::vector<SpMat> P = levelProlongations;
+      P.back() = St * P.back();
+      if(!fieldMG.setup(AF * S, P))
+        return -2;
+      mgFactoredWeights = fieldWeights;
+    }
+
+    mgIterations = 0;
+    for(Eigen::Index c = 0; c < fieldValues.cols(); ++c){
+      Eigen::VectorXd rhs(V);
+      for(size_t i = 0; i < V; ++i){
+        const double sw = isFree[i] ? std::max(0.0, fieldWeights[i]) : 0.0;
+        rhs[i] = mgMass[i] * (sw * fieldValues(i, c) + fieldSources(i, c));
+      }
+      // Dirichlet values
+      Eigen::VectorXd fixed = Eigen::VectorXd::Zero(V);
+      for(size_t i = 0; i < V; ++i){
+        if(!isFree[i])
+          fixed[i] = fieldValues(i, c);
+      }
+      const Eigen::VectorXd rhsF = St * rhs - AF * fixed;
+      Eigen::VectorXd solF = Eigen::VectorXd::Zero(numFree);
+      fieldMG.solve(rhsF, solF, mgTolerance, mgMaxIterations);
+      mgIterations += fieldMG.iterations;
+      fieldSolution.col(c) = S * solF + fixed;
+    }
+
+    // direction field
+    if(normalize){
+      for(size_t i = 0; i < V; ++i){
+        const double len = fieldSolution.row(i).norm();
+        if(len > 1e-12)
+          fieldSolution.row(i) /= len;
+      }
+    }
+    return 0;
+  }
+
+}
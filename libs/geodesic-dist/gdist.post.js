@@ -20,8 +20,23 @@ function gridSet(arr, num_rows, row, col, value){
   arr[row + col * num_rows] = value;
 }
 let numVertices = 0;
+let backend = 'direct'; // or 'multigrid' or 'iterative'
 const g = Module;
-g.precompute = function precompute(faces, edges, params){
+
+/**
+ * Message of the last error from the module
+ *
+ * @return the error message string
+ */
+function errorMessage(){
+  const ptr = g._get_error_message();
+  let str = '';
+  for(let i = ptr; g.HEAPU8[i]; ++i)
+    str += String.fromCharCode(g.HEAPU8[i]);
+  return str;
+}
+
+function setMeshData(faces, edges, params){
 
   // 1 = check face data + edge data
   const vertices  = new Set();
@@ -46,8 +61,11 @@ g.precompute = function precompute(faces, edges, params){
   // 2 = set potential parameters
   for(const pair of [
     ['robust',    'robust'],
+    ['intrinsicCache', 'intrinsic_cache'],
     ['timeStep',  'time_step'],
-    ['verbose',   'verbose']
+    ['verbose',   'verbose'],
+    ['float32',   'float32'],
+    ['warmStart', 'warm_start']
   ]){
     const [name, key] = pair;
     if(name in params){
@@ -58,7 +76,10 @@ g.precompute = function precompute(faces, edges, params){
   }
 
   // 3 = allocate and set mesh data
+  // /!\ growing the memory once for the whole precomputation,
+  //     and creating the views after allocation
   const F = faces.length;
+  g._reserve(g._plan_capacity(F, numVertices));
   const fptr = g._allocate_faces(F);
   const findex = new Uint32Array(
     g.HEAPU32.buffer, fptr, F*3);
@@ -79,21 +100,210 @@ g.precompute = function precompute(faces, edges, params){
     }
   }
 
+  return vertices.size;
+}
+
+g.precompute = function precompute(faces, edges, params){
+  // 1-3 = set mesh data
+  const numVerts = setMeshData(faces, edges, params);
+
   // 4 = precompute
-  g._create_surface_mesh();
-  g._precompute();
+  let rc = g._create_surface_mesh();
+  assert(rc === 0, errorMessage());
+  rc = g._precompute();
+  assert(rc === 0, errorMessage());
 
   // 5 = mark that we have vertices stored
-  numVertices = vertices.size;
+  numVertices = numVerts;
+  backend = 'direct';
+};
+
+/**
+ * Precompute multigrid solvers over a mesh hierarchy,
+ * where the given mesh is the finest level.
+ *
+ * Coarse operators are Galerkin products of the fine ones,
+ * so the coarse levels are only described by their prolongations.
+ *
+ * @param faces the finest mesh faces
+ * @param edges the finest mesh edge lengths
+ * @param prolongations [{ numCoarse, entries: [[fine, coarse, weight]] }]
+ *        from the coarsest level to the finest mesh
+ * @param params { timeStep, verbose, float32, warmStart, tolerance, heatTolerance, maxIterations }
+ */
+g.precomputeMultigrid = function precomputeMultigrid(
+  faces, edges, prolongations, params = {}
+){
+  assert(prolongations.length > 0, 'Multigrid requires at least two levels');
+  const numVerts = setMeshData(faces, edges, params);
+  setIterativeParams(params);
+
+  // set prolongation levels
+  g._allocate_levels(prolongations.length + 1);
+  for(let l = 0; l < prolongations.length; ++l){
+    const { numCoarse, entries } = prolongations[l];
+    const numFine = l + 1 < prolongations.length
+                  ? prolongations[l + 1].numCoarse : numVerts;
+    g._allocate_prolongation(l + 1, numFine, numCoarse, entries.length);
+    for(const [fine, coarse, weight] of entries)
+      g._set_prolongation_entry(l + 1, fine, coarse, weight);
+  }
+  const rc = g._precompute_multigrid();
+  assert(rc === 0, rc === -1 ? 'Invalid mesh hierarchy'
+                             : 'Coarse level factorization failed');
+
+  numVertices = numVerts;
+  backend = 'multigrid';
+};
+
+function setIterativeParams(params){
+  if('tolerance' in params)
+    g._set_mg_tolerance(params.tolerance);
+  if('heatTolerance' in params)
+    g._set_mg_heat_tolerance(params.heatTolerance);
+  if('maxIterations' in params)
+    g._set_mg_max_iterations(params.maxIterations);
+}
+
+/**
+ * Precompute incomplete Cholesky preconditioned CG solvers
+ * (iterative backend without mesh hierarchy).
+ *
+ * The Poisson solve of each source is warm-started from the previous
+ * source's potential (with warmStart, the default), which works best
+ * when traversing sources in the sourceOrder() order.
+ * The heat solve always starts from zero.
+ *
+ * @param faces the mesh faces
+ * @param edges the mesh edge lengths
+ * @param params { timeStep, verbose, float32, warmStart, tolerance, heatTolerance, maxIterations }
+ */
+g.precomputeIterative = function precomputeIterative(faces, edges, params = {}){
+  const numVerts = setMeshData(faces, edges, params);
+  setIterativeParams(params);
+  const rc = g._precompute_iterative();
+  assert(rc === 0, rc === -1 ? 'No mesh data' : 'Incomplete factorization failed');
+
+  numVertices = numVerts;
+  backend = 'iterative';
 };
+
+/**
+ * Source order such that consecutive sources are mostly mesh neighbors,
+ * for warm-starting the iterative Poisson solves.
+ *
+ * @param start the first source vertex
+ * @return Int32Array of the vertex indices
+ */
+g.sourceOrder = function sourceOrder(start = 0){
+  assert(numVertices > 0,
+    'No valid precomputation yet');
+  const ptr = g._compute_source_order(start);
+  return new Int32Array(g.HEAP32.buffer, ptr, numVertices).slice();
+};
+
+/**
+ * Iteration counts of the last source with an iterative backend
+ *
+ * @return { heat, poisson }
+ */
+g.lastIterations = function lastIterations(){
+  return {
+    heat: g._get_heat_iterations(),
+    poisson: g._get_poisson_iterations()
+  };
+};
+/**
+ * Compute the distances from a source vertex
+ *
+ * @param idx the source vertex index
+ * @return a view of the distances, as a Float32Array
+ *         if precomputed with float32, else a Float64Array
+ *         (valid until the next call, since the memory may grow)
+ */
 g.distancesTo = function distancesTo(idx){
   assert(numVertices > 0,
     'No valid precomputation yet');
 
     // compute from source
-    const dptr = g._compute_from_source(idx);
+    let dptr;
+    switch(backend){
+      case 'multigrid': dptr = g._compute_from_source_mg(idx); break;
+      case 'iterative': dptr = g._compute_from_source_iterative(idx); break;
+      default:          dptr = g._compute_from_source(idx); break;
+    }
+    assert(dptr, 'Invalid source vertex ' + idx);
   
     // wrap data into typed array
+    if(g._get_float32()){
+      return new Float32Array(
+        g.HEAPF32.buffer, dptr, numVertices);
+    }
     return new Float64Array(
       g.HEAPF64.buffer, dptr, numVertices);
-};
\ No newline at end of file
+};
+
+/**
+ * Solve a screened Poisson problem over the mesh vertices
+ *
+ *    (L + M W) u = M (W c + f)
+ *
+ * reusing the factorization while the weights do not change.
+ *
+ * @param weights per-vertex screening weights (Infinity for Dirichlet values)
+ * @param values per-vertex values c (numbers, or arrays for multiple channels)
+ * @param sources per-vertex sources f (same layout as values, optional)
+ * @param normalize whether to normalize the per-vertex channel vectors
+ * @return Float64Array view per channel (valid until the next call)
+ */
+g.solveField = function solveField({
+  weights, values, sources = null, normalize = false
+}){
+  assert(numVertices > 0,
+    'No valid precomputation yet');
+  assert(backend !== 'iterative',
+    'Field solves require the direct or multigrid precomputation');
+  assert(weights.length === numVertices && values.length === numVertices,
+    'Field data must be per-vertex');
+  const C = Array.isArray(values[0]) ? values[0].length : 1;
+
+  // 1 = allocate and set field data
+  g._reserve(g._plan_field_capacity(C));
+  const wptr = g._allocate_field(C);
+  new Float64Array(g.HEAPF64.buffer, wptr, numVertices).set(weights);
+  const vdata = new Float64Array(
+    g.HEAPF64.buffer, g._get_field_value_ptr(), numVertices * C);
+  const sdata = new Float64Array(
+    g.HEAPF64.buffer, g._get_field_source_ptr(), numVertices * C);
+  for(let i = 0; i < numVertices; ++i){
+    for(let c = 0; c < C; ++c){
+      gridSet(vdata, numVertices, i, c, C > 1 ? values[i][c] : values[i]);
+      if(sources)
+        gridSet(sdata, numVertices, i, c, C > 1 ? sources[i][c] : sources[i]);
+    }
+  }
+
+  // 2 = solve
+  const rc = backend === 'multigrid'
+           ? g._solve_field_mg(normalize)
+           : g._solve_field(normalize);
+  assert(rc === 0, rc === -1 ? 'No valid precomputation yet'
+                             : 'Singular field system (no constraint)');
+
+  // 3 = wrap channels into typed arrays
+  const sptr = g._get_field_solution_ptr();
+  return Array.from({ length: C }, (_, c) => {
+    return new Float64Array(
+      g.HEAPF64.buffer, sptr + c * numVertices * 8, numVertices);
+  });
+};
+
+/**
+ * Smooth a 2d direction field given per-vertex constraint directions
+ * expressed in a common frame (weight Infinity to fix a direction)
+ *
+ * @return Float64Array[2] of unit directions (x and y components)
+ */
+g.smoothDirections = function smoothDirections(weights, directions){
+  return g.solveField({ weights, values: directions, normalize: true });
+};
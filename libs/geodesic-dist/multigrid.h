@@ -0,0 +1,394 @@
+#ifndef GDIST_MULTIGRID_H
+#define GDIST_MULTIGRID_H
+
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/IterativeLinearSolvers>
+#include <math.h>
+#include <vector>
+
+typedef Eigen::SparseMatrix<double> SpMat;
+
+/**
+ * Build the (positive semi-definite) cotan Laplacian and the lumped mass
+ * of a triangle mesh from its faces and per-face edge lengths,
+ * where edges(f, k) is the length from faces(f, k) to faces(f, (k+1)%3).
+ *
+ * @return the mean edge length
+ */
+inline double build_cotan_laplacian(
+  const Eigen::MatrixX3i &faces,
+  const Eigen::MatrixX3d &edges,
+  size_t num_vertices,
+  SpMat &L,
+  Eigen::VectorXd &mass
+){
+  std::vector<Eigen::Triplet<double>> entries;
+  entries.reserve(faces.rows() * 12);
+  mass.setZero(num_vertices);
+  double sumLength = 0;
+  for(Eigen::Index f = 0; f < faces.rows(); ++f){
+    const double a = edges(f, 0), b = edges(f, 1), c = edges(f, 2);
+    const double s = 0.5 * (a + b + c);
+    const double area = std::sqrt(std::max(1e-24, s * (s - a) * (s - b) * (s - c)));
+    for(int k = 0; k < 3; ++k){
+      // edge k goes from vertex k to vertex k+1 and faces the vertex k+2
+      const int i = faces(f, k), j = faces(f, (k + 1) % 3);
+      const double lij = edges(f, k);
+      const double ljk = edges(f, (k + 1) % 3);
+      const double lki = edges(f, (k + 2) % 3);
+      const double w = 0.5 * (ljk * ljk + lki * lki - lij * lij) / (4 * area);
+      entries.emplace_back(i, j, -w);
+      entries.emplace_back(j, i, -w);
+      entries.emplace_back(i, i, w);
+      entries.emplace_back(j, j, w);
+      mass[i] += area / 3;
+      sumLength += lij;
+    }
+  }
+  L.resize(num_vertices, num_vertices);
+  L.setFromTriplets(entries.begin(), entries.end());
+  return faces.rows() ? sumLength / (3 * faces.rows()) : 1.0;
+}
+
+/**
+ * Heat method gradient normalization and divergence:
+ * computes div(-grad(u) / |grad(u)|) at the vertices,
+ * with faces laid out intrinsically from their edge lengths.
+ */
+template <typename Scalar>
+void normalized_gradient_divergence(
+  const Eigen::MatrixX3i &faces,
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, 3> &edges,
+  const Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &u,
+  Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &div
+){
+  div.setZero(u.size());
+  for(Eigen::Index f = 0; f < faces.rows(); ++f){
+    // layout: p0 = (0, 0), p1 = (l01, 0), p2 above the x axis
+    const Scalar l01 = edges(f, 0), l12 = edges(f, 1), l20 = edges(f, 2);
+    const Scalar x2 = (l01 * l01 + l20 * l20 - l12 * l12) / (2 * l01);
+    const Scalar y2 = std::sqrt(std::max(Scalar(0), l20 * l20 - x2 * x2));
+    const Scalar area = Scalar(0.5) * l01 * y2;
+    if(area <= 0)
+      continue; // degenerate face
+    const Scalar px[3] = { 0, l01, x2 };
+    const Scalar py[3] = { 0, 0, y2 };
+
+    // gradient = sum_i u_i rot90(p_{i+2} - p_{i+1}) / (2A)
+    Scalar gx = 0, gy = 0;
+    for(int i = 0; i < 3; ++i){
+      const int j = (i + 1) % 3, k = (i + 2) % 3;
+      const Scalar ex = px[k] - px[j], ey = py[k] - py[j];
+      const Scalar ui = u[faces(f, i)];
+      gx += ui * -ey;
+      gy += ui * ex;
+    }
+    const Scalar len = std::sqrt(gx * gx + gy * gy);
+    if(len <= 0)
+      continue; // no direction
+    const Scalar Xx = -gx / len, Xy = -gy / len;
+
+    // divergence = 1/2 sum cot(theta_k) (e_ij . X) + cot(theta_j) (e_ik . X)
+    for(int i = 0; i < 3; ++i){
+      const int j = (i + 1) % 3, k = (i + 2) % 3;
+      const Scalar e1x = px[j] - px[i], e1y = py[j] - py[i]; // opposite to k
+      const Scalar e2x = px[k] - px[i], e2y = py[k] - py[i]; // opposite to j
+      const Scalar cotk = ((px[i] - px[k]) * (px[j] - px[k])
+                         + (py[i] - py[k]) * (py[j] - py[k])) / (2 * area);
+      const Scalar cotj = ((px[i] - px[j]) * (px[k] - px[j])
+                         + (py[i] - py[j]) * (py[k] - py[j])) / (2 * area);
+      div[faces(f, i)] += Scalar(0.5) * (
+        cotk * (e1x * Xx + e1y * Xy) + cotj * (e2x * Xx + e2y * Xy)
+      );
+    }
+  }
+}
+
+/**
+ * Multigrid-preconditioned conjugate gradient for SPD systems.
+ *
+ * Level 0 is the coarsest and is factored directly.
+ * Coarse operators are Galerkin products P^T A P,
+ * so only the prolongations between levels are needed.
+ * The V-cycle uses forward Gauss-Seidel before and backward after
+ * the coarse correction, which keeps the preconditioner symmetric.
+ */
+template <typename Scalar>
+struct BasicMultigrid {
+  typedef Eigen::SparseMatrix<Scalar>             Mat;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vec;
+
+  std::vector<Mat>              prolong;  // prolong[l]: level l -> level l+1
+  std::vector<Mat>              ops;      // ops[l]: operator of level l
+  Eigen::SimplicialLDLT<Mat>    coarse;
+  int                           smoothing = 2;
+
+  // last solve statistics
+  size_t                        iterations = 0;
+  double                        residual = 0;
+
+  // scratch
+  std::vector<Vec>              rhs, sol, tmp;
+  Vec                           r, z, p, q;
+
+  size_t num_levels() const { return ops.size(); }
+  bool ready() const { return !ops.empty(); }
+  void clear(){ ops.clear(); prolong.clear(); }
+  const Mat &matrix() const { return ops.back(); }
+
+  // prolongations are given from the coarsest (P[0]: level 0 -> 1)
+  bool setup(const Mat &A, const std::vector<Mat> &P){
+    prolong = P;
+    const size_t L = P.size() + 1;
+    ops.resize(L);
+    ops[L - 1] = A;
+    for(size_t l = L - 1; l > 0; --l){
+      Mat Ac = Mat(prolong[l - 1].transpose()) * ops[l] * prolong[l - 1];
+      // decouple coarse vertices without fine support (e.g. Dirichlet)
+      for(Eigen::Index i = 0; i < Ac.rows(); ++i){
+        if(Ac.coeff(i, i) <= 0)
+          Ac.coeffRef(i, i) = 1;
+      }
+      Ac.prune(Scalar(0));
+      ops[l - 1] = Ac;
+    }
+    coarse.compute(ops[0]);
+    rhs.resize(L);
+    sol.resize(L);
+    tmp.resize(L);
+    for(size_t l = 0; l < L; ++l){
+      rhs[l].setZero(ops[l].rows());
+      sol[l].setZero(ops[l].rows());
+      tmp[l].setZero(ops[l].rows());
+    }
+    return coarse.info() == Eigen::Success;
+  }
+
+  // one Gauss-Seidel sweep (A is symmetric, so columns are rows)
+  static void gauss_seidel(
+    const Mat &A, const Vec &b, Vec &x, bool forward
+  ){
+    const Eigen::Index n = A.cols();
+    for(Eigen::Index t = 0; t < n; ++t){
+      const Eigen::Index i = forward ? t : n - 1 - t;
+      Scalar sum = b[i];
+      Scalar diag = 0;
+      for(typename Mat::InnerIterator it(A, i); it; ++it){
+        if(it.row() == i)
+          diag = it.value();
+        else
+          sum -= it.value() * x[it.row()];
+      }
+      if(diag != 0)
+        x[i] = sum / diag;
+    }
+  }
+
+  // x = V(b) at level l (using rhs[l] as input and sol[l] as output)
+  void vcycle(size_t l){
+    Vec &b = rhs[l];
+    Vec &x = sol[l];
+    if(l == 0){
+      x = coarse.solve(b);
+      return;
+    }
+    const Mat &A = ops[l];
+    x.setZero();
+    for(int s = 0; s < smoothing; ++s)
+      gauss_seidel(A, b, x, true);
+    tmp[l].noalias() = b - A * x;
+    rhs[l - 1].noalias() = prolong[l - 1].transpose() * tmp[l];
+    vcycle(l - 1);
+    x.noalias() += prolong[l - 1] * sol[l - 1];
+    for(int s = 0; s < smoothing; ++s)
+      gauss_seidel(A, b, x, false);
+  }
+
+  // preconditioned conjugate gradient from the initial value of x
+  // returns true if the relative residual reached tol
+  bool solve(
+    const Vec &b, Vec &x,
+    double tol = 1e-8, size_t max_iter = 200
+  ){
+    const size_t L = ops.size();
+    const Mat &A = ops[L - 1];
+    if(x.size() != b.size())
+      x.setZero(b.size());
+    const double bnorm = std::max(1e-300, double(b.norm()));
+    r.noalias() = b - A * x;
+    residual = r.norm() / bnorm;
+    iterations = 0;
+    if(residual <= tol)
+      return true;
+    rhs[L - 1] = r;
+    vcycle(L - 1);
+    z = sol[L - 1];
+    p = z;
+    Scalar rz = r.dot(z);
+    while(iterations < max_iter){
+      ++iterations;
+      q.noalias() = A * p;
+      const Scalar alpha = rz / p.dot(q);
+      x += alpha * p;
+      r -= alpha * q;
+      residual = r.norm() / bnorm;
+      if(residual <= tol)
+        return true;
+      rhs[L - 1] = r;
+      vcycle(L - 1);
+      z = sol[L - 1];
+      const Scalar rz_new = r.dot(z);
+      p = z + (rz_new / rz) * p;
+      rz = rz_new;
+    }
+    return false;
+  }
+};
+
+typedef BasicMultigrid<double> Multigrid;
+
+/**
+ * Mixed-precision iterative refinement:
+ * the hierarchy and its PCG iterations are in single precision,
+ * while the residual and the solution are accumulated in double precision,
+ * so the outer tolerance can be below the single-precision epsilon.
+ */
+struct MixedMultigrid {
+  SpMat                         op;       // double-precision operator
+  BasicMultigrid<float>         inner;
+  double                        inner_tol = 1e-3;
+
+  // last solve statistics
+  size_t                        iterations = 0;
+  size_t                        refinements = 0;
+  double                        residual = 0;
+
+  // scratch
+  Eigen::VectorXd               r;
+  Eigen::VectorXf               rf, df;
+
+  size_t num_levels() const { return inner.num_levels(); }
+  bool ready() const { return inner.ready(); }
+  void clear(){ inner.clear(); op.resize(0, 0); }
+  const SpMat &matrix() const { return op; }
+
+  bool setup(const SpMat &A, const std::vector<SpMat> &P){
+    op = A;
+    std::vector<Eigen::SparseMatrix<float>> Pf(P.size());
+    for(size_t l = 0; l < P.size(); ++l)
+      Pf[l] = P[l].cast<float>();
+    return inner.setup(A.cast<float>(), Pf);
+  }
+
+  // refined solve from the initial value of x
+  // returns true if the relative residual reached tol
+  bool solve(
+    const Eigen::VectorXd &b, Eigen::VectorXd &x,
+    double tol = 1e-8, size_t max_iter = 200
+  ){
+    if(x.size() != b.size())
+      x.setZero(b.size());
+    const double bnorm = std::max(1e-300, b.norm());
+    iterations = refinements = 0;
+    r.noalias() = b - op * x;
+    residual = r.norm() / bnorm;
+    while(residual > tol && iterations < max_iter){
+      // correction in single precision, relative to the current residual
+      const double rnorm = r.norm();
+      rf = (r / rnorm).cast<float>();
+      df.setZero(rf.size());
+      inner.solve(rf, df, std::max(inner_tol, tol / residual), max_iter - iterations);
+      if(inner.iterations == 0)
+        break; // no progress possible
+      iterations += inner.iterations;
+      ++refinements;
+      x += rnorm * df.cast<double>();
+      r.noalias() = b - op * x;
+      const double previous = residual;
+      residual = r.norm() / bnorm;
+      if(residual > 0.5 * previous)
+        break; // stagnation at the rounding floor of the double residual
+    }
+    return residual <= tol;
+  }
+};
+
+/**
+ * Conjugate gradient with an incomplete Cholesky preconditioner,
+ * for meshes without hierarchy (same interface as Multigrid).
+ */
+struct IncompleteCholeskyCG {
+  typedef Eigen::IncompleteCholesky<double> Preconditioner;
+  SpMat                         op;
+  Eigen::ConjugateGradient<SpMat, Eigen::Lower | Eigen::Upper, Preconditioner> cg;
+  bool                          factored = false;
+
+  // last solve statistics
+  size_t                        iterations = 0;
+  double                        residual = 0;
+
+  bool ready() const { return factored; }
+  void clear(){ factored = false; op.resize(0, 0); }
+  const SpMat &matrix() const { return op; }
+
+  bool setup(const SpMat &A){
+    op = A;
+    cg.compute(op);
+    factored = cg.info() == Eigen::Success;
+    return factored;
+  }
+
+  // preconditioned conjugate gradient from the initial value of x
+  // returns true if the relative residual reached tol
+  bool solve(
+    const Eigen::VectorXd &b, Eigen::VectorXd &x,
+    double tol = 1e-8, size_t max_iter = 200
+  ){
+    if(x.size() != b.size())
+      x.setZero(b.size());
+    cg.setTolerance(tol);
+    cg.setMaxIterations(max_iter);
+    x = cg.solveWithGuess(b, x);
+    iterations = cg.iterations();
+    residual = cg.error();
+    return cg.info() == Eigen::Success;
+  }
+};
+
+/**
+ * Sparse Cholesky factorization (same interface as Multigrid),
+ * for the direct solves over the intrinsic triangulation.
+ * The solves are exact, so the initial value of x is ignored.
+ */
+struct DirectCholesky {
+  SpMat                         op;
+  Eigen::SimplicialLDLT<SpMat>  ldlt;
+  bool                          factored = false;
+
+  // last solve statistics
+  size_t                        iterations = 0;
+  double                        residual = 0;
+
+  bool ready() const { return factored; }
+  void clear(){ factored = false; op.resize(0, 0); }
+  const SpMat &matrix() const { return op; }
+
+  bool setup(const SpMat &A){
+    op = A;
+    ldlt.compute(op);
+    factored = ldlt.info() == Eigen::Success;
+    return factored;
+  }
+
+  bool solve(
+    const Eigen::VectorXd &b, Eigen::VectorXd &x,
+    double = 0, size_t = 0
+  ){
+    x = ldlt.solve(b);
+    return ldlt.info() == Eigen::Success;
+  }
+};
+
+#endif
@@ -0,0 +1,116 @@
+"use strict";
+
+const tmod = require('./gdist.js');
+tmod().then(gdist => {
+  // compare the distances of the iterative backends
+  // against the direct solver, over a N x N grid of unit squares,
+  // with an off-center source, so that the heat is tiny in the far corner,
+  // which is where the accuracy of the heat solve matters most
+  const N = 65;
+  const id = (i, j) => i * N + j;
+  const faces = [];
+  const edges = [];
+  for(let i = 0; i + 1 < N; ++i){
+    for(let j = 0; j + 1 < N; ++j){
+      faces.push([id(i, j), id(i + 1, j), id(i + 1, j + 1)]);
+      edges.push([1, 1, Math.SQRT2]);
+      faces.push([id(i, j), id(i + 1, j + 1), id(i, j + 1)]);
+      edges.push([Math.SQRT2, 1, 1]);
+    }
+  }
+
+  // bilinear prolongations from the coarsest grid to the finest one
+  const prolongations = [];
+  for(let n = N; n > 9; n = (n + 1) / 2){
+    const c = (n + 1) / 2;
+    const entries = [];
+    for(let i = 0; i < n; ++i){
+      for(let j = 0; j < n; ++j){
+        const ci = i >> 1, oi = i & 1;
+        const cj = j >> 1, oj = j & 1;
+        for(let a = 0; a <= oi; ++a){
+          for(let b = 0; b <= oj; ++b){
+            const w = (oi ? 0.5 : 1.0) * (oj ? 0.5 : 1.0);
+            entries.push([i * n + j, (ci + a) * c + (cj + b), w]);
+          }
+        }
+      }
+    }
+    prolongations.unshift({ numCoarse: c * c, entries });
+  }
+
+  const src = id(N >> 2, N / 3 | 0);
+  const params = { timeStep: 1.0 };
+
+  console.log('Direct distances');
+  gdist.precompute(faces, edges, params);
+  const ref = gdist.distancesTo(src).slice();
+  let maxDist = 0;
+  for(const d of ref)
+    maxDist = Math.max(maxDist, d);
+  console.log('- max distance = ' + maxDist);
+
+  // the backends share the same discretization up to the Poisson shift,
+  // so the remaining error is that of the iterative solves
+  const maxError = 1e-2 * maxDist;
+  let failed = false;
+  const check = (name) => {
+    const dist = gdist.distancesTo(src);
+    const { heat, poisson } = gdist.lastIterations();
+    let err = 0;
+    for(let i = 0; i < ref.length; ++i)
+      err = Math.max(err, Math.abs(dist[i] - ref[i]));
+    const ok = err <= maxError;
+    failed = failed || !ok;
+    console.log('- ' + name + ': max error = ' + err
+      + ' after ' + heat + ' + ' + poisson + ' iterations'
+      + (ok ? '' : ' /!\\ FAILED'));
+  };
+
+  console.log('Iterative distances');
+  gdist.precomputeIterative(faces, edges, params);
+  check('incomplete Cholesky CG');
+
+  console.log('Multigrid distances');
+  gdist.precomputeMultigrid(faces, edges, prolongations, params);
+  check('multigrid');
+
+  // compare the cached intrinsic triangulation of the robust mode
+  // against the robust HeatMethodDistanceSolver, over a jittered grid
+  // so that the intrinsic triangulation needs edge flips
+  const jitter = (i, j, k) => {
+    const x = Math.sin(i * 12.9898 + j * 78.233 + k * 37.719) * 43758.5453;
+    return 0.3 * (x - Math.floor(x) - 0.5);
+  };
+  const pos = (v) => {
+    const i = Math.floor(v / N), j = v % N;
+    return [i + jitter(i, j, 0), j + jitter(i, j, 1)];
+  };
+  const dist2D = (p, q) => Math.hypot(p[0] - q[0], p[1] - q[1]);
+  const jedges = faces.map(([a, b, c]) => {
+    const [pa, pb, pc] = [a, b, c].map(pos);
+    return [dist2D(pa, pb), dist2D(pb, pc), dist2D(pc, pa)];
+  });
+
+  console.log('Robust distances');
+  gdist.precompute(faces, jedges, {
+    robust: true, intrinsicCache: false, timeStep: 1.0
+  });
+  const robustRef = gdist.distancesTo(src).slice();
+  let robustMax = 0;
+  for(const d of robustRef)
+    robustMax = Math.max(robustMax, d);
+  gdist.precompute(faces, jedges, { robust: true, intrinsicCache: true });
+  const cached = gdist.distancesTo(src);
+  let robustErr = 0;
+  for(let i = 0; i < robustRef.length; ++i)
+    robustErr = Math.max(robustErr, Math.abs(cached[i] - robustRef[i]));
+  const robustOk = robustErr <= 1e-3 * robustMax;
+  failed = failed || !robustOk;
+  console.log('- intrinsic cache: max error = ' + robustErr
+    + ' for a max distance of ' + robustMax
+    + (robustOk ? '' : ' /!\\ FAILED'));
+
+  if(failed)
+    process.exitCode = 1;
+});
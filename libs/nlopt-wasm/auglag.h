@@ -0,0 +1,225 @@
+#ifndef NLOPT_WASM_AUGLAG_H
+#define NLOPT_WASM_AUGLAG_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "build/nlopt.hpp"
+#include "copt.h"
+
+/**
+ * Augmented Lagrangian outer loop over an nlopt inner optimizer.
+ *
+ * Same scheme as nlopt's AUGLAG (Birgin and Martinez),
+ * except that the multipliers and penalty weight are kept
+ * between solves and can be read or seeded from outside,
+ * so that consecutive similar problems can be warm-started.
+ *
+ * The kept duals are only reused for a problem with the same signature
+ * (a hash of the problem data, see hash below), since multipliers
+ * are matched to constraints by index. Seeded duals are always used.
+ */
+struct AugLag {
+
+    struct Constraint {
+        nlopt::vfunc func;
+        void         *data;
+        bool         equality;
+    };
+
+    // problem
+    nlopt::vfunc            objective = nullptr;
+    void                    *obj_data = nullptr;
+    std::vector<Constraint> constraints;
+
+    // dual state (kept across solves)
+    std::vector<double>     lambda;     // multipliers
+    double                  rho = 0;    // penalty weight
+    uint64_t                signature = 0; // problem of the dual state
+    bool                    seeded = false; // duals set from outside
+    size_t                  outer_iters = 0;
+    size_t                  num_evals = 0;  // inner evaluations
+
+    // scratch
+    std::vector<double>     cgrad;
+    std::vector<double>     none;
+
+    // reserve the buffers of a problem (so that solves do not allocate)
+    void reserve(size_t n, size_t num_constraints){
+        constraints.reserve(num_constraints);
+        lambda.reserve(num_constraints);
+        cgrad.reserve(n);
+    }
+
+    void reset_problem(nlopt::vfunc f, void *f_data){
+        objective = f;
+        obj_data = f_data;
+        constraints.clear();
+    }
+    void add_constraint(nlopt::vfunc f, void *data, bool equality){
+        constraints.push_back({ f, data, equality });
+    }
+    void reset_duals(){
+        lambda.assign(constraints.size(), 0.0);
+        rho = 0;
+    }
+
+    // problem signature (FNV-1a over the problem data)
+    static uint64_t hash(uint64_t h, const void *data, size_t bytes){
+        const uint8_t *ptr = static_cast<const uint8_t*>(data);
+        for(size_t i = 0; i < bytes; ++i){
+            h ^= ptr[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+    template <typename T>
+    static uint64_t hash(uint64_t h, const T &value){
+        return hash(h, &value, sizeof(T));
+    }
+    template <typename T>
+    static uint64_t hash(uint64_t h, const std::vector<T> &values){
+        h = hash(h, values.size());
+        return values.empty() ? h : hash(h, values.data(), values.size() * sizeof(T));
+    }
+    static const uint64_t HASH_BASIS = 0xcbf29ce484222325ULL;
+
+    static double augmented(
+        const std::vector<double>   &x,
+        std::vector<double>         &grad,
+        void*                       data
+    ){
+        AugLag &al = *static_cast<AugLag*>(data);
+        const bool has_grad = !grad.empty();
+        if(has_grad)
+            std::fill(grad.begin(), grad.end(), 0.0);
+        double L = al.objective(x, grad, al.obj_data);
+        for(size_t i = 0; i < al.constraints.size(); ++i){
+            const Constraint &c = al.constraints[i];
+            if(has_grad)
+                std::fill(al.cgrad.begin(), al.cgrad.end(), 0.0);
+            const double v = c.func(x, has_grad ? al.cgrad : al.none, c.data);
+            const double t = v + al.lambda[i] / al.rho;
+            if(!c.equality && t <= 0)
+                continue; // inactive inequality
+            L += 0.5 * al.rho * t * t;
+            if(has_grad){
+                for(size_t j = 0; j < grad.size(); ++j)
+                    grad[j] += al.rho * t * al.cgrad[j];
+            }
+        }
+        return L;
+    }
+
+    // maximum constraint violation (updating the multipliers if requested)
+    double violation(const std::vector<double> &x, bool update){
+        double icm = 0;
+        for(size_t i = 0; i < constraints.size(); ++i){
+            const Constraint &c = constraints[i];
+            const double v = c.func(x, none, c.data);
+            if(c.equality){
+                icm = std::max(icm, std::abs(v));
+                if(update)
+                    lambda[i] += rho * v;
+            } else {
+                icm = std::max(icm, std::max(0.0, v));
+                if(update)
+                    lambda[i] = std::max(0.0, lambda[i] + rho * v);
+            }
+        }
+        return icm;
+    }
+
+    /**
+     * Prepare for a solve over n variables.
+     * The multipliers and penalty are reset unless warm_start is set
+     * and they were either seeded, or kept from a problem
+     * with the same signature and number of constraints.
+     *
+     * @return whether the previous duals were kept
+     */
+    bool prepare(size_t n, bool warm_start, uint64_t problem){
+        const bool warm = warm_start
+                       && lambda.size() == constraints.size()
+                       && (seeded || problem == signature);
+        if(!warm)
+            reset_duals();
+        signature = problem;
+        seeded = false;
+        cgrad.resize(n);
+        return warm;
+    }
+
+    /**
+     * Minimize from x using inner (which must have its bounds set)
+     */
+    nlopt::result optimize(
+        COpt                &inner,
+        std::vector<double> &x,
+        double              &fval,
+        double              ctol,
+        double              ftol_rel,
+        size_t              max_eval,
+        bool                verbose = false
+    ){
+
+        // initial penalty (as in nlopt)
+        // /!\ a warm-started penalty is capped, since the large values
+        //     reached at the end of a solve make the next one ill-conditioned
+        if(rho > 0)
+            rho = std::min(rho, 10.0);
+        else {
+            const double f = objective(x, none, obj_data);
+            double icm2 = 0;
+            for(const Constraint &c : constraints){
+                const double v = c.func(x, none, c.data);
+                if(c.equality || v > 0)
+                    icm2 += v * v;
+            }
+            rho = icm2 > 0 ? std::max(1e-6, std::min(10.0, 2 * std::abs(f) / icm2)) : 1.0;
+        }
+        inner.set_min_objective(augmented, this);
+
+        num_evals = 0;
+        double prev_icm = HUGE_VAL;
+        double prev_f = HUGE_VAL;
+        nlopt::result res = nlopt::MAXEVAL_REACHED;
+        for(outer_iters = 1; ; ++outer_iters){
+            inner.set_maxeval(std::max<size_t>(1, max_eval - num_evals));
+            double minf;
+            const nlopt::result inner_res = inner.optimize(x, minf);
+            num_evals += inner.get_numevals();
+            // /!\ with roundoff errors, the current point is still usable
+            if(inner_res < 0 && inner_res != nlopt::ROUNDOFF_LIMITED){
+                res = inner_res;
+                break;
+            }
+
+            // update multipliers and penalty
+            const double icm = violation(x, true);
+            fval = objective(x, none, obj_data);
+            if(verbose)
+                printf("AL iter %zu: f=%g, icm=%g, rho=%g\n", outer_iters, fval, icm, rho);
+            if(icm > 0.5 * prev_icm)
+                rho *= 10;
+
+            // stopping criteria
+            if(icm <= ctol && std::abs(fval - prev_f) <= ftol_rel * std::abs(fval)){
+                res = nlopt::FTOL_REACHED;
+                break;
+            }
+            if(num_evals >= max_eval){
+                res = nlopt::MAXEVAL_REACHED;
+                break;
+            }
+            prev_icm = icm;
+            prev_f = fval;
+        }
+        return res;
+    }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef NLOPT_WASM_COPT_H
+#define NLOPT_WASM_COPT_H
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "../nlopt/src/api/nlopt.h"
+#include "build/nlopt.hpp"
+
+/**
+ * Optimizer over nlopt's C API with the interface of nlopt::opt
+ * (for the subset used by the modules), but without exceptions:
+ * failures are reported through nlopt result codes.
+ *
+ * The first setter failure is kept and returned by optimize,
+ * where nlopt::opt would have thrown at the setter.
+ *
+ * Objectives and constraints are nlopt::vfunc over std::vector,
+ * evaluated through buffers owned by the module (see Buffers),
+ * with the gradient zeroed before each evaluation.
+ */
+class COpt {
+
+    struct VFunc {
+        nlopt::vfunc f;
+        void         *data;
+        COpt         *owner;
+    };
+
+public:
+    /**
+     * Callbacks and evaluation buffers of an optimizer.
+     *
+     * They are owned by the module and reserved with the problem,
+     * so that creating an optimizer within a solve does not allocate.
+     * A buffer set is used by a single optimizer at a time.
+     */
+    struct Buffers {
+        std::deque<VFunc>   funcs;  // stable addresses for the C callbacks
+        std::vector<double> xtmp;
+        std::vector<double> gtmp;
+
+        void reserve(size_t n, size_t num_funcs){
+            xtmp.reserve(n);
+            gtmp.reserve(n);
+            while(funcs.size() < num_funcs)
+                funcs.emplace_back();
+        }
+
+        // heap bytes of reserve(n, num_funcs)
+        static size_t bytes(size_t n, size_t num_funcs){
+            return 2 * n * sizeof(double) + num_funcs * sizeof(VFunc) + 1024;
+        }
+    };
+
+private:
+    nlopt_opt           opt;
+    nlopt::result       status = nlopt::SUCCESS;
+    Buffers             &buf;
+    size_t              num_funcs = 0;
+    std::vector<double> none;
+
+    static double call(unsigned n, const double *x, double *grad, void *data){
+        VFunc &vf = *static_cast<VFunc*>(data);
+        COpt &o = *vf.owner;
+        std::vector<double> &xtmp = o.buf.xtmp;
+        std::vector<double> &gtmp = o.buf.gtmp;
+        std::copy(x, x + n, xtmp.begin());
+        if(!grad)
+            return vf.f(xtmp, o.none, vf.data);
+        std::fill(gtmp.begin(), gtmp.end(), 0.0);
+        const double val = vf.f(xtmp, gtmp, vf.data);
+        std::copy(gtmp.begin(), gtmp.end(), grad);
+        return val;
+    }
+
+    void check(nlopt_result res){
+        if(res < 0 && status >= 0)
+            status = static_cast<nlopt::result>(res);
+    }
+
+    VFunc *wrap(nlopt::vfunc f, void *data){
+        // /!\ reuse the callbacks of previous optimizers
+        if(num_funcs == buf.funcs.size())
+            buf.funcs.emplace_back();
+        VFunc &vf = buf.funcs[num_funcs++];
+        vf = { f, data, this };
+        return &vf;
+    }
+
+public:
+    COpt(nlopt::algorithm algo, unsigned n, Buffers &buffers)
+    : opt(nlopt_create(static_cast<nlopt_algorithm>(algo), n)), buf(buffers) {
+        buf.xtmp.resize(n);
+        buf.gtmp.resize(n);
+        if(!opt)
+            status = nlopt::OUT_OF_MEMORY;
+    }
+    ~COpt(){
+        nlopt_destroy(opt);
+    }
+    COpt(const COpt &) = delete;
+    COpt &operator=(const COpt &) = delete;
+
+    // stopping criteria and parameters
+    void set_population(unsigned pop){ check(nlopt_set_population(opt, pop)); }
+    void set_initial_step(double dx){ check(nlopt_set_initial_step1(opt, dx)); }
+    void set_stopval(double val){ check(nlopt_set_stopval(opt, val)); }
+    void set_ftol_abs(double tol){ check(nlopt_set_ftol_abs(opt, tol)); }
+    void set_ftol_rel(double tol){ check(nlopt_set_ftol_rel(opt, tol)); }
+    void set_xtol_rel(double tol){ check(nlopt_set_xtol_rel(opt, tol)); }
+    void set_xtol_abs(double tol){ check(nlopt_set_xtol_abs1(opt, tol)); }
+    void set_x_weights(double w){ check(nlopt_set_x_weights1(opt, w)); }
+    void set_vector_storage(unsigned dim){ check(nlopt_set_vector_storage(opt, dim)); }
+    void set_maxeval(int n){ check(nlopt_set_maxeval(opt, n)); }
+    void set_maxtime(double t){ check(nlopt_set_maxtime(opt, t)); }
+    void set_local_optimizer(const COpt &local){
+        check(nlopt_set_local_optimizer(opt, local.opt));
+    }
+
+    // bounds
+    void set_lower_bounds(double lb){ check(nlopt_set_lower_bounds1(opt, lb)); }
+    void set_upper_bounds(double ub){ check(nlopt_set_upper_bounds1(opt, ub)); }
+    void set_lower_bounds(const std::vector<double> &lb){
+        check(nlopt_set_lower_bounds(opt, lb.data()));
+    }
+    void set_upper_bounds(const std::vector<double> &ub){
+        check(nlopt_set_upper_bounds(opt, ub.data()));
+    }
+
+    // objective and constraints
+    void set_min_objective(nlopt::vfunc f, void *data){
+        check(nlopt_set_min_objective(opt, call, wrap(f, data)));
+    }
+    void add_inequality_constraint(nlopt::vfunc f, void *data, double tol){
+        check(nlopt_add_inequality_constraint(opt, call, wrap(f, data), tol));
+    }
+    void add_equality_constraint(nlopt::vfunc f, void *data, double tol){
+        check(nlopt_add_equality_constraint(opt, call, wrap(f, data), tol));
+    }
+
+    /**
+     * Minimize from x (in place)
+     *
+     * @return the nlopt result (negative on failure)
+     */
+    nlopt::result optimize(std::vector<double> &x, double &fval){
+        if(status < 0)
+            return status;
+        return static_cast<nlopt::result>(nlopt_optimize(opt, x.data(), &fval));
+    }
+
+    /**
+     * Estimate of the heap bytes used by nlopt while optimizing n variables
+     * (quasi-Newton history of the default vector storage and work vectors,
+     * for the gradient-based algorithms in use)
+     */
+    static size_t workspace_bytes(size_t n){
+        return n * 32 * sizeof(double) + 4096;
+    }
+
+    // information
+    int get_numevals() const {
+        return opt ? nlopt_get_numevals(opt) : 0;
+    }
+    const char *get_errmsg() const {
+        const char *msg = opt ? nlopt_get_errmsg(opt) : nullptr;
+        return msg ? msg : "";
+    }
+    const char *get_algorithm_name() const {
+        return opt ? nlopt_algorithm_name(nlopt_get_algorithm(opt)) : "";
+    }
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef NLOPT_WASM_EVALS_H
+#define NLOPT_WASM_EVALS_H
+
+#include <vector>
+#include "build/nlopt.hpp"
+#include "../wasm_stats.h"
+
+/**
+ * Objective and constraint wrappers counting the solver evaluations.
+ *
+ * The evaluations from diagnostics (errors, gradient check)
+ * call the functions directly and are not counted.
+ */
+template <nlopt::vfunc F>
+double counted_objective(
+    const std::vector<double> &x, std::vector<double> &grad, void *data
+){
+    ++module_stats.objective_evals;
+    return F(x, grad, data);
+}
+
+template <nlopt::vfunc F>
+double counted_constraint(
+    const std::vector<double> &x, std::vector<double> &grad, void *data
+){
+    ++module_stats.constraint_evals;
+    return F(x, grad, data);
+}
+
+#endif
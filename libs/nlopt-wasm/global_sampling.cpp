@@ -7,9 +7,16 @@
 #include "../nlopt/src/api/nlopt.h"
 #include "../nlopt/src/util/nlopt-util.h"
 #include "build/nlopt.hpp"
+#include "copt.h"
+#include "scratch.h"
+#include "auglag.h"
+#include "evals.h"
+#include "../wasm_heap.h"
 
 typedef size_t index_t;
 
+const uint32_t stats_module_id = STATS_GLOBAL;
+
 struct Node {
     index_t              index;
     bool                 simple;
@@ -51,12 +58,13 @@ struct VarAlias {
     inline bool has_constraint() const {
         // if aliased using negative terms,
         // then we need a constraint to ensure this alias is above the minimum bound
-        return neg.size() > 1; 
+        return !neg.empty();
     }
 };
 
 // inputs
 static std::vector<double>  cdata;
+static std::vector<double>  cweights;   // course weight per edge (empty = unit)
 static std::vector<double>  wdata;
 static std::vector<double>  iwdata;
 static std::vector<Node>    nodes;
@@ -72,7 +80,8 @@ static enum AliasingLevel {
     TRIVIAL = 1,
     BASIC   = 2,
     COMPLEX = 3,
-    NUM_ALIASING_LEVELS = 4
+    NULLSPACE = 4,
+    NUM_ALIASING_LEVELS = 5
 }                               aliasing_level = NONE;
 static std::vector<index_t>     redToAlias;     // map from reduced variable to alias
 static std::vector<index_t>     aliasToRed;     // map from alias to reduced variable
@@ -92,17 +101,55 @@ static double               constraint_tol = 1e-1;
 static size_t               seed = 0xDEADBEEF;
 static bool                 gaussian_start = false;
 static bool                 global_shaping = false;
+static bool                 multilevel = false;
+static bool                 warm_duals = false;
 
 // outputs
 static std::vector<double>  nvars;
 static std::vector<double>  ngrad;
 static double               objval;
 static std::vector<double>  nograd;
+static std::vector<double>  ivars;          // integer-feasible incumbent
+static double               iobjval;
+
+// evaluation scratch buffers
+static Scratch              scratch;
+
+// augmented Lagrangian with persistent multipliers
+static AugLag               auglag;
+
+// optimizer buffers (see COpt)
+static COpt::Buffers        main_buffers;
+static COpt::Buffers        local_buffers;
 
 inline double loss(double x){
     return x * x;
 }
 
+inline double course_weight(size_t e){
+    return cweights.empty() ? 1.0 : cweights[e];
+}
+
+/**
+ * Signature of the current problem, so that the duals
+ * of the augmented Lagrangian are only reused on the same problem
+ * (the constraints depend on the graph, the aliasing and the course data).
+ */
+uint64_t problem_signature(){
+    uint64_t h = AugLag::HASH_BASIS;
+    h = AugLag::hash(h, aliasing_level);
+    h = AugLag::hash(h, global_shaping);
+    h = AugLag::hash(h, cdata);
+    h = AugLag::hash(h, cweights);
+    h = AugLag::hash(h, wdata);
+    for(const Node &node : nodes){
+        h = AugLag::hash(h, node.simple);
+        h = AugLag::hash(h, node.inp_edges);
+        h = AugLag::hash(h, node.out_edges);
+    }
+    return h;
+}
+
 template<typename T>
 inline void from_reduced_to_aliases(
     const std::vector<T> &rns,
@@ -165,9 +212,115 @@ inline void set_reduced_from_aliases(
         rns[i] = ns[redToAlias[i]]; // no gather, just direct copy
 }
 
+/**
+ * Alias variables over a null-space basis of all interface constraints.
+ *
+ * The interface nodes are vertices of a graph in which all other nodes
+ * (simple nodes and boundaries) are merged into a single free vertex.
+ * Its edges are the variables, and the interface equalities are the flow
+ * conservation at all constrained vertices, whose solutions are the
+ * circulations of the graph. Given a spanning tree, each non-tree edge
+ * is a free variable and each tree edge is the signed sum of the non-tree
+ * edges whose fundamental cycle goes through it.
+ *
+ * @return whether all tree edges are on a cycle
+ */
+bool compute_nullspace_aliases(){
+    const size_t E = cdata.size();
+    const size_t N = nodes.size();
+    const index_t free_vertex = N;
+    const index_t NONE = std::numeric_limits<index_t>::max();
+
+    // edge end vertices
+    std::vector<index_t> edge_src(E, free_vertex);
+    std::vector<index_t> edge_trg(E, free_vertex);
+    for(const Node &node : nodes){
+        if(!node.has_interface_constraint())
+            continue;
+        for(index_t e : node.inp_edges)
+            edge_trg[e] = node.index;
+        for(index_t e : node.out_edges)
+            edge_src[e] = node.index;
+    }
+    std::vector<std::vector<index_t>> adjacency(N + 1);
+    for(index_t e = 0; e < E; ++e){
+        if(edge_src[e] == edge_trg[e])
+            continue; // self-loop => always free
+        adjacency[edge_src[e]].push_back(e);
+        adjacency[edge_trg[e]].push_back(e);
+    }
+
+    // breadth-first spanning forest (from the free vertex first)
+    std::vector<index_t> parent_edge(N + 1, NONE);
+    std::vector<index_t> depth(N + 1, NONE);
+    std::vector<bool> in_tree(E, false);
+    std::vector<index_t> queue;
+    for(index_t r = 0; r <= N; ++r){
+        const index_t root = r == 0 ? free_vertex : r - 1;
+        if(depth[root] != NONE)
+            continue;
+        depth[root] = 0;
+        queue.assign(1, root);
+        for(index_t q = 0; q < queue.size(); ++q){
+            const index_t v = queue[q];
+            for(index_t e : adjacency[v]){
+                const index_t w = edge_src[e] == v ? edge_trg[e] : edge_src[e];
+                if(depth[w] != NONE)
+                    continue;
+                depth[w] = depth[v] + 1;
+                parent_edge[w] = e;
+                in_tree[e] = true;
+                queue.push_back(w);
+            }
+        }
+    }
+
+    // fundamental cycles
+    // = the flow of f from its source a to its target b
+    //   goes back from b to a through the tree
+    for(index_t f = 0; f < E; ++f){
+        if(in_tree[f])
+            continue;
+        index_t a = edge_src[f];
+        index_t b = edge_trg[f];
+        while(a != b){
+            if(depth[b] >= depth[a]){
+                // going up from b
+                const index_t t = parent_edge[b];
+                if(edge_src[t] == b)
+                    aliases[t].pos.push_back(f);
+                else
+                    aliases[t].neg.push_back(f);
+                b = edge_src[t] == b ? edge_trg[t] : edge_src[t];
+            } else {
+                // going down to a
+                const index_t t = parent_edge[a];
+                if(edge_trg[t] == a)
+                    aliases[t].pos.push_back(f);
+                else
+                    aliases[t].neg.push_back(f);
+                a = edge_src[t] == a ? edge_trg[t] : edge_src[t];
+            }
+        }
+    }
+
+    // tree edges on no cycle (bridges) must be zero
+    // => infeasible with positive bounds, keep the constraints
+    for(index_t e = 0; e < E; ++e){
+        if(in_tree[e] && aliases[e].empty())
+            return false;
+    }
+    for(const Node &node : nodes){
+        if(node.has_interface_constraint())
+            reduced[node.index] = true;
+    }
+    return true;
+}
+
 void compute_aliases(){
     if(aliased)
         return; // already done
+    ALLOC_SETUP(); // structural work, cached on the fine problem
     
     // reset aliases
     VarAlias noAlias;
@@ -181,6 +334,14 @@ void compute_aliases(){
     if(aliasing_level == NONE)
         return; // nothing to do
 
+    // null-space aliasing reduces all interface nodes
+    // and falls back to complex aliasing otherwise
+    if(aliasing_level == NULLSPACE && !compute_nullspace_aliases()){
+        aliases.assign(aliases.size(), noAlias);
+        for(index_t i = 0; i < aliases.size(); ++i)
+            aliases[i].index = i;
+    }
+
     // go over nodes and find cases to reduce
     // /!\ this assumes the graph is bipartite with blue/green separation
     //     so that we can go over nodes and never create an aliasing conflict
@@ -216,7 +377,7 @@ void compute_aliases(){
                 alias.pos = node.inp_edges;
             }
 
-        } else if(aliasing_level == COMPLEX){
+        } else if(aliasing_level >= COMPLEX){
             // case n => m, with n,m>1
             // this is a complex aliasing case with additional constraint
             // we use the first output as alias
@@ -253,10 +414,153 @@ void compute_aliases(){
     rvars.resize(redToAlias.size());
 }
 
+/**
+ * Global problem data that can be swapped with the module state
+ * (used to solve a coarse problem with the same machinery)
+ */
+struct GlobalProblem {
+    std::vector<double>     cdata;
+    std::vector<double>     cweights;
+    std::vector<double>     wdata;
+    std::vector<double>     iwdata;
+    std::vector<Node>       nodes;
+    std::vector<VarAlias>   aliases;
+    std::vector<bool>       reduced;
+    std::vector<index_t>    redToAlias;
+    std::vector<index_t>    aliasToRed;
+    std::vector<double>     rvars;
+    std::vector<double>     nvars;
+    std::vector<double>     ngrad;
+    Scratch                 scratch;
+    bool                    aliased = false;
+    double                  objval = 0;
+
+    void swap_state(){
+        std::swap(this->cdata, ::cdata);
+        std::swap(this->cweights, ::cweights);
+        std::swap(this->wdata, ::wdata);
+        std::swap(this->iwdata, ::iwdata);
+        std::swap(this->nodes, ::nodes);
+        std::swap(this->aliases, ::aliases);
+        std::swap(this->reduced, ::reduced);
+        std::swap(this->redToAlias, ::redToAlias);
+        std::swap(this->aliasToRed, ::aliasToRed);
+        std::swap(this->rvars, ::rvars);
+        std::swap(this->nvars, ::nvars);
+        std::swap(this->ngrad, ::ngrad);
+        std::swap(this->scratch, ::scratch);
+        std::swap(this->aliased, ::aliased);
+        std::swap(this->objval, ::objval);
+    }
+};
+
+// coarsening buffers, reused across solves
+static std::vector<index_t> coarse_parent;
+static std::vector<index_t> coarse_root;
+
+inline index_t find_root(std::vector<index_t> &parent, index_t i){
+    while(parent[i] != i){
+        parent[i] = parent[parent[i]]; // path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Coarsen the problem by merging chains of simple nodes.
+ *
+ * All edges connected through simple nodes (1 input, 1 output)
+ * are merged into a single coarse edge whose target is the mean of
+ * their cdata, and whose course term is weighted by the chain length,
+ * so that the coarse objective matches the fine one over solutions
+ * that are constant along chains (up to a constant).
+ * The coarse graph only keeps the interface nodes.
+ *
+ * @param coarse the coarse problem to build
+ * @param edge_map the coarse edge of each fine edge
+ * @return the number of coarse edges
+ */
+size_t coarsen(GlobalProblem &coarse, std::vector<index_t> &edge_map){
+    ALLOC_SETUP(); // the buffers only grow on the first solves
+    const size_t E = cdata.size();
+    // union of edges through chain nodes
+    std::vector<index_t> &parent = coarse_parent;
+    parent.resize(E);
+    for(index_t e = 0; e < E; ++e)
+        parent[e] = e;
+    for(const Node &node : nodes){
+        if(!node.simple
+        || node.inp_edges.size() != 1
+        || node.out_edges.size() != 1)
+            continue;
+        index_t r0 = find_root(parent, node.inp());
+        index_t r1 = find_root(parent, node.out());
+        if(r0 != r1)
+            parent[std::max(r0, r1)] = std::min(r0, r1);
+    }
+    // coarse edges with average cdata
+    const index_t none = std::numeric_limits<index_t>::max();
+    std::vector<index_t> &root_map = coarse_root;
+    root_map.assign(E, none);
+    edge_map.resize(E);
+    coarse.cdata.clear();
+    coarse.cweights.clear();
+    for(index_t e = 0; e < E; ++e){
+        index_t r = find_root(parent, e);
+        if(root_map[r] == none){
+            root_map[r] = coarse.cdata.size();
+            coarse.cdata.push_back(0.0);
+            coarse.cweights.push_back(0.0);
+        }
+        index_t c = edge_map[e] = root_map[r];
+        coarse.cdata[c] += course_weight(e) * cdata[e];
+        coarse.cweights[c] += course_weight(e);
+    }
+    const size_t C = coarse.cdata.size();
+    for(index_t c = 0; c < C; ++c)
+        coarse.cdata[c] /= coarse.cweights[c];
+
+    // coarse nodes = interface nodes
+    // /!\ reusing the edge buffers of the previous coarse nodes
+    size_t N = 0;
+    for(const Node &node : nodes){
+        if(!node.has_interface_constraint())
+            continue;
+        if(N == coarse.nodes.size())
+            coarse.nodes.emplace_back();
+        Node &cnode = coarse.nodes[N];
+        cnode.index = N++;
+        cnode.simple = false;
+        cnode.inp_edges.resize(node.inp_edges.size());
+        for(index_t i = 0; i < node.inp_edges.size(); ++i)
+            cnode.inp_edges[i] = edge_map[node.inp_edges[i]];
+        cnode.out_edges.resize(node.out_edges.size());
+        for(index_t i = 0; i < node.out_edges.size(); ++i)
+            cnode.out_edges[i] = edge_map[node.out_edges[i]];
+    }
+    coarse.nodes.resize(N);
+
+    // allocate remaining coarse data
+    coarse.wdata.assign(N, 1.0);
+    coarse.iwdata.assign(N, 1.0);
+    coarse.aliases.resize(C);
+    coarse.reduced.resize(N);
+    coarse.nvars.resize(C);
+    coarse.ngrad.resize(C);
+    coarse.scratch.allocate(C);
+    coarse.aliased = false;
+    return C;
+}
+
+// coarse problem buffers, reused across solves
+static GlobalProblem        coarse_problem;
+static std::vector<index_t> coarse_edge_map;
+
 extern "C" {
 
-    // forward declaration
+    // forward declarations
     double global_constraint_error(const std::vector<double> &);
+    int solve(bool verbose);
 
     double global_sampling(
         const std::vector<double>   &ns,
@@ -269,12 +573,13 @@ extern "C" {
         // course errors (and possibly gradient)
         if(grad.size() > 0){
             for(size_t i = 0, n = cdata.size(); i < n; ++i){
-                Ec += loss(ns[i] - cdata[i]);
-                grad[i] = w_c * 2 * (ns[i] - cdata[i]);
+                const double w = course_weight(i);
+                Ec += w * loss(ns[i] - cdata[i]);
+                grad[i] = w * w_c * 2 * (ns[i] - cdata[i]);
             }
         } else {
             for(size_t i = 0, n = cdata.size(); i < n; ++i)
-                Ec += loss(ns[i] - cdata[i]);
+                Ec += course_weight(i) * loss(ns[i] - cdata[i]);
         }
 
         // node errors (wales + singularity)
@@ -338,17 +643,17 @@ extern "C" {
         void*                       f_data
     ){
         // compute unreduced variable values
-        from_reduced_to_aliases(rns, nvars);
+        from_reduced_to_aliases(rns, scratch.vars);
 
         // simple case without gradient
         if(rgrad.empty())
-            return global_sampling(nvars, nograd, f_data);
+            return global_sampling(scratch.vars, nograd, f_data);
 
         // case with gradient (needs map back)
-        double E = global_sampling(nvars, ngrad, f_data);
+        double E = global_sampling(scratch.vars, scratch.grad, f_data);
 
         // map gradient back
-        from_aliases_to_reduced(ngrad, rgrad);
+        from_aliases_to_reduced(scratch.grad, rgrad);
 
         // return error
         return E;
@@ -385,17 +690,19 @@ extern "C" {
         void*                       eq_data
     ){
         // compute unreduced variable values
-        from_reduced_to_aliases(rns, nvars);
+        from_reduced_to_aliases(rns, scratch.vars);
 
         // simple case without gradient
         if(rgrad.empty())
-            return global_interface_constraint(nvars, nograd, eq_data);
+            return global_interface_constraint(scratch.vars, nograd, eq_data);
 
         // case with gradient (needs map back)
-        double E = global_interface_constraint(nvars, ngrad, eq_data);
+        // /!\ the constraint only sets its own entries
+        std::fill(scratch.grad.begin(), scratch.grad.end(), 0.0);
+        double E = global_interface_constraint(scratch.vars, scratch.grad, eq_data);
 
         // map gradient back
-        from_aliases_to_reduced(ngrad, rgrad);
+        from_aliases_to_reduced(scratch.grad, rgrad);
 
         // return error
         return E;
@@ -520,19 +827,21 @@ extern "C" {
     }
 
     double get_gradient_error(
-        const std::vector<double> ns,
+        const std::vector<double> &ns,
         nlopt::vfunc f, void *f_data,
         double epsilon,
         bool relative = true
     ){
         double max_err = 0;
         // compute analytical gradient
-        std::vector<double> grad_ana(ns.size());
+        std::vector<double> &grad_ana = scratch.grad_ana;
+        std::fill(grad_ana.begin(), grad_ana.end(), 0.0);
         f(ns, grad_ana, f_data);
 
         // compute numerical gradients for each dimension
         // and accumulate error per dimension
-        std::vector<double> ns_delta = ns; // copy
+        std::vector<double> &ns_delta = scratch.delta;
+        std::copy(ns.begin(), ns.end(), ns_delta.begin());
         for(index_t i = 0; i < cdata.size(); ++i){
             // plus value
             ns_delta[i] = ns[i] + epsilon;
@@ -565,20 +874,54 @@ extern "C" {
         return max_err;
     }
 
+    // /!\ nodes and aliases are kept so that their edge buffers
+    //     are reused by the next problem (see allocate_node and compute_aliases)
     EMSCRIPTEN_KEEPALIVE
     void reset(){
         nvars.clear();
         cdata.clear();
-        aliases.clear();
         reduced.clear();
         wdata.clear();
         iwdata.clear();
-        nodes.clear();
         aliased = false;
     }
 
+    /**
+     * Heap bytes needed by a problem (see reserve in wasm_heap.h)
+     *
+     * Includes the coarse problem of multilevel solves,
+     * which is at most as large as the fine one.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    size_t plan_capacity(size_t num_edges, size_t num_nodes){
+        // per-edge data (cdata, nvars, ngrad, ivars, rvars, scratch)
+        size_t bytes = 9 * vector_bytes<double>(num_edges);
+        // aliases with one term each, and reduced maps
+        bytes += vector_bytes<VarAlias>(num_edges)
+               + num_edges * vector_bytes<index_t>(1)
+               + 2 * vector_bytes<index_t>(num_edges);
+        // per-node data, with each edge in the lists of two nodes
+        bytes += 2 * vector_bytes<double>(num_nodes)
+               + vector_bytes<Node>(num_nodes)
+               + num_nodes * 2 * HEAP_CHUNK_OVERHEAD
+               + 2 * num_edges * sizeof(index_t);
+        // coarse problem (with its course weights),
+        // its edge map and coarsening buffers, and nlopt workspace
+        bytes = 2 * bytes + vector_bytes<double>(num_edges)
+              + 3 * vector_bytes<index_t>(num_edges);
+        // optimizer and augmented Lagrangian buffers
+        const size_t num_funcs = 1 + 3 * num_nodes + num_edges;
+        bytes += COpt::Buffers::bytes(num_edges, num_funcs)
+               + COpt::Buffers::bytes(num_edges, 1)
+               + vector_bytes<AugLag::Constraint>(num_funcs)
+               + vector_bytes<double>(num_funcs)
+               + vector_bytes<double>(num_edges);
+        return bytes + COpt::workspace_bytes(num_edges);
+    }
+
     EMSCRIPTEN_KEEPALIVE
     void allocate(size_t num_edges, size_t num_nodes){
+        StatsPhaseTimer timer(PHASE_SETUP);
         reset();
         nvars.resize(num_edges);
         ngrad.resize(num_edges);
@@ -588,9 +931,15 @@ extern "C" {
         iwdata.resize(num_nodes);
         nodes.resize(num_nodes);
         reduced.resize(num_nodes);
+        scratch.allocate(num_edges);
+        // objective and constraints (at most three per node and one per alias)
+        const size_t num_funcs = 1 + 3 * num_nodes + num_edges;
+        main_buffers.reserve(num_edges, num_funcs);
+        local_buffers.reserve(num_edges, 1);
+        auglag.reserve(num_edges, num_funcs);
     }
 
-    void set_nlopt_defaults(nlopt::opt &opt){
+    void set_nlopt_defaults(COpt &opt){
         opt.set_population(0);
         opt.set_initial_step(1.0);
         opt.set_stopval(-HUGE_VAL);
@@ -601,9 +950,41 @@ extern "C" {
         opt.set_vector_storage(0);
     }
 
+    // solve the coarsened problem and prolongate its solution to nvars
+    bool multilevel_init(bool verbose){
+        GlobalProblem &coarse = coarse_problem;
+        std::vector<index_t> &edge_map = coarse_edge_map;
+        const size_t C = coarsen(coarse, edge_map);
+        if(verbose)
+            printf("Multilevel: from %zu to %zu variables\n", cdata.size(), C);
+        if(C == cdata.size())
+            return false; // nothing to coarsen
+
+        // solve coarse problem
+        // /!\ std::swap keeps element addresses, so the fine data stays valid
+        // /!\ the fine multipliers must not be replaced by coarse ones
+        coarse.swap_state();
+        const bool fine_warm_duals = warm_duals;
+        multilevel = false;
+        warm_duals = false;
+        int rc = solve(verbose);
+        multilevel = true;
+        warm_duals = fine_warm_duals;
+        coarse.swap_state();
+        if(rc < 0)
+            return false;
+
+        // prolongate coarse solution
+        for(index_t e = 0; e < edge_map.size(); ++e)
+            nvars[e] = coarse.nvars[edge_map[e]];
+        return true;
+    }
+
     // call solver and return its return code
     EMSCRIPTEN_KEEPALIVE
     int solve(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true); // outer solve only
+        ALLOC_GUARD();
         // local debug function
         const auto debug = [&verbose](auto&& ...args){
             if(!verbose)
@@ -611,6 +992,9 @@ extern "C" {
             printf(args...);
         };
 
+        // coarse initialization
+        const bool warm_start = multilevel && multilevel_init(verbose);
+
         // reset seed
         nlopt::srand(seed);
 
@@ -622,10 +1006,36 @@ extern "C" {
         // reset iter number
         curr_iter = 0;
 
-        // create nlopt optimizer(s)
+        // problem size
         const size_t n = aliasing_level == NONE ? nvars.size() : rvars.size();
-        nlopt::opt opt(main_algo, n);
-        nlopt::opt local_opt(local_algo, n);
+
+        // main algorithm and tolerance (adapted to bound-only problems)
+        nlopt::algorithm algo = main_algo;
+        double ftol_rel = main_ftol_rel;
+
+        // without remaining constraints, the null-space problem
+        // only has bounds and needs no penalty loop
+        if(aliasing_level == NULLSPACE && !global_shaping){
+            bool bound_only = true;
+            for(const Node &node : nodes){
+                if(node.has_interface_constraint() && !reduced[node.index])
+                    bound_only = false;
+            }
+            for(const VarAlias &alias : aliases){
+                if(use_constraints && alias.has_constraint())
+                    bound_only = false;
+            }
+            if(bound_only){
+                algo = local_algo;
+                if(!ftol_rel)
+                    ftol_rel = local_ftol_rel;
+                debug("Null-space problem with bounds only\n");
+            }
+        }
+
+        // create nlopt optimizer(s)
+        COpt opt(algo, n, main_buffers);
+        COpt local_opt(local_algo, n, local_buffers);
 
         // defaults
         set_nlopt_defaults(opt);
@@ -634,7 +1044,7 @@ extern "C" {
         debug("Using algorithm: %s\n", opt.get_algorithm_name());
 
         // register local optimizer
-        if(main_algo >= nlopt::AUGLAG){
+        if(algo >= nlopt::AUGLAG){
             // set relative tolerance
             local_opt.set_ftol_rel(local_ftol_rel);
             // set local optimizer
@@ -649,15 +1059,22 @@ extern "C" {
         // set optimizer parameters
         nlopt::vfunc objective_func;
         if(aliasing_level == NONE)
-            objective_func = global_sampling;
+            objective_func = counted_objective<global_sampling>;
         else
-            objective_func = global_reduced_sampling;
+            objective_func = counted_objective<global_reduced_sampling>;
         opt.set_min_objective(objective_func, NULL);
+
+        // own augmented Lagrangian loop for warm-started multipliers
+        const bool own_auglag = warm_duals && (
+            algo == nlopt::AUGLAG
+         || algo == nlopt::AUGLAG_EQ
+        );
+        auglag.reset_problem(objective_func, NULL);
         
         // user defined
-        if(main_ftol_rel){
-            opt.set_ftol_rel(main_ftol_rel);
-            debug("Using ftol_rel=%g\n", main_ftol_rel);
+        if(ftol_rel){
+            opt.set_ftol_rel(ftol_rel);
+            debug("Using ftol_rel=%g\n", ftol_rel);
         }
         if(max_eval){
             opt.set_maxeval(max_eval);
@@ -681,15 +1098,19 @@ extern "C" {
         min_bound = std::max(2.0, min_bound);
         opt.set_lower_bounds(min_bound);
         opt.set_upper_bounds(max_bound);
+        if(own_auglag){
+            local_opt.set_lower_bounds(min_bound);
+            local_opt.set_upper_bounds(max_bound);
+        }
         debug("Using bounds: min=%g, max=%g\n\n", min_bound, max_bound);
 
         // add equality constraints
         if(use_constraints){
             nlopt::vfunc constraint_func;
             if(aliasing_level == NONE)
-                constraint_func = global_interface_constraint;
+                constraint_func = counted_constraint<global_interface_constraint>;
             else
-                constraint_func = global_reduced_constraint;
+                constraint_func = counted_constraint<global_reduced_constraint>;
             
             // unreduced node constraints
             for(Node &node : nodes){
@@ -698,6 +1119,7 @@ extern "C" {
                     opt.add_equality_constraint(
                         constraint_func, &node, constraint_tol
                     );
+                    auglag.add_constraint(constraint_func, &node, true);
                     debug("Constraint on node #%u (#inp=%u, #out=%u)\n",
                         node.index,
                         node.inp_edges.size(),
@@ -710,8 +1132,9 @@ extern "C" {
                 if(alias.has_constraint()){
                     alias.min_bound = min_bound;
                     opt.add_inequality_constraint(
-                        global_alias_constraint, &alias, constraint_tol
+                        counted_constraint<global_alias_constraint>, &alias, constraint_tol
                     );
+                    auglag.add_constraint(counted_constraint<global_alias_constraint>, &alias, false);
                     debug("Constraint on alias #%u (#pos=%u, #neg=%u) > %g\n",
                         alias.index,
                         alias.pos.size(),
@@ -725,11 +1148,13 @@ extern "C" {
             for(Node &node : nodes){
                 if(node.has_range_constraint()){
                     opt.add_inequality_constraint(
-                        global_urange_constraint, &node, constraint_tol
+                        counted_constraint<global_urange_constraint>, &node, constraint_tol
                     );
                     opt.add_inequality_constraint(
-                        global_lrange_constraint, &node, constraint_tol
+                        counted_constraint<global_lrange_constraint>, &node, constraint_tol
                     );
+                    auglag.add_constraint(counted_constraint<global_urange_constraint>, &node, false);
+                    auglag.add_constraint(counted_constraint<global_lrange_constraint>, &node, false);
                     debug("Range constraints on node #%u (#inp=%u, #out=%u, w=%g, iw=%g)\n",
                         node.index,
                         node.inp(),
@@ -742,7 +1167,13 @@ extern "C" {
         }
 
         // use cdata as initial guess
-        nvars.assign(cdata.begin(), cdata.end());
+        // unless warm-started from the coarse solution
+        if(warm_start){
+            for(double &val : nvars)
+                val = std::max(min_bound, std::min(max_bound, val));
+        } else {
+            nvars.assign(cdata.begin(), cdata.end());
+        }
         if(gaussian_start){
             // perturb starting point with Gaussian noise
             for(index_t i = 0; i < nvars.size(); ++i){
@@ -758,71 +1189,263 @@ extern "C" {
             set_reduced_from_aliases(nvars, rvars);
         }
         if(verbose){
-            std::vector<double> grad(cdata.size());
+            // /!\ the reduced gradient only uses the first rvars.size() entries
+            std::vector<double> &grad = scratch.grad_ana;
+            std::fill(grad.begin(), grad.end(), 0.0);
             double err0 = global_sampling(nvars, grad, NULL);
             printf("Initial error: %g\n", err0);
             for(index_t i = 0; i < grad.size(); ++i){
                 printf("grad[%zu] = %g\n", i, grad[i]);
             }
             if(aliasing_level > NONE){
-                std::vector<double> rgrad(rvars.size());
+                std::vector<double> &rgrad = scratch.delta;
                 double rerr0 = global_reduced_sampling(rvars, rgrad, NULL);
                 printf("Initial reduced error: %g\n", rerr0);
-                for(index_t i = 0; i < rgrad.size(); ++i){
+                for(index_t i = 0; i < rvars.size(); ++i){
                     printf("rgrad[%zu] = %g\n", i, rgrad[i]);
                 }
             }
         }
 
-        int rc = 0;
-
         // perform optimization
-        try {
-            curr_iter = 1; // start considering iterations
-            nlopt::result res;
-            if(aliasing_level == NONE)
-                res = opt.optimize(nvars, objval);
-            else {
-                res = opt.optimize(rvars, objval);
-                // store full variable content
-                from_reduced_to_aliases(rvars, nvars);
-            }
+        curr_iter = 1; // start considering iterations
+        nlopt::result res;
+        std::vector<double> &vars = aliasing_level == NONE ? nvars : rvars;
+        if(own_auglag)
+            stats_cache(auglag.prepare(n, true, problem_signature())); // warm duals
+        if(own_auglag){
+            res = auglag.optimize(
+                local_opt, vars, objval, constraint_tol,
+                ftol_rel ? ftol_rel : 1e-6,
+                max_eval ? max_eval : 1e3, verbose
+            );
+            debug("Outer iterations: %u\n", auglag.outer_iters);
+        } else
+            res = opt.optimize(vars, objval);
+        // store full variable content
+        if(aliasing_level > NONE)
+            from_reduced_to_aliases(rvars, nvars);
 
+        if(!own_auglag)
             debug("Solved after %u iterations\n", opt.get_numevals());
 
-            // return the result code as an integer
-            // + positive: success
-            //  1 = generic success
-            //  2 = stopval reached
-            //  3 = ftol reached
-            //  4 = xtol reached
-            //  5 = maxeval reached
-            //  6 = maxtime reached
-            // - negative: error
-            //  -1 = generic failure
-            //  -2 = invalid argument (e.g. bounds or algorithm)
-            //  -3 = out-of-memory
-            //  -4 = roundoff errors limiting progress
-            //  -5 = forced stop
-            rc = static_cast<int>(res);
-
-        } catch (const std::exception& ex) {
-            printf("\nException(ex): %s\n", ex.what());
+        // return the result code as an integer
+        // + positive: success
+        //  1 = generic success
+        //  2 = stopval reached
+        //  3 = ftol reached
+        //  4 = xtol reached
+        //  5 = maxeval reached
+        //  6 = maxtime reached
+        // - negative: error
+        //  -1 = generic failure
+        //  -2 = invalid argument (e.g. bounds or algorithm)
+        //  -3 = out-of-memory
+        //  -4 = roundoff errors limiting progress
+        //  -5 = forced stop
+        const int rc = static_cast<int>(res);
+        if(rc < 0){
+            printf("\nFailed with code %d\n", rc);
             printf("Message: %s\n", opt.get_errmsg());
             printf("After %u iterations\n", opt.get_numevals());
+        }
 
-        } catch (const std::string& ex) {
-            printf("\nException(str): %s\n", ex.c_str());
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+        return rc;
+    }
 
-        } catch (...) {
-            printf("\nUnknown exception\n");
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+    // marginal objective change when moving the integer count of edge e by d
+    double repair_step_cost(
+        index_t e, double d, double lo, double hi,
+        const std::vector<index_t> &edge_src,
+        const std::vector<index_t> &edge_trg
+    ){
+        const double x = ivars[e];
+        if(x + d < lo || x + d > hi)
+            return HUGE_VAL; // out of bounds
+        double cost = w_c * course_weight(e) * (loss(x + d - cdata[e]) - loss(x - cdata[e]));
+        // simplicity terms of both end nodes
+        for(index_t n : { edge_src[e], edge_trg[e] }){
+            if(n >= nodes.size())
+                continue; // boundary edge
+            const Node &node = nodes[n];
+            if(!node.simple
+            || node.inp_edges.empty()
+            || node.out_edges.empty())
+                continue; // no error associated
+            const double diff = global_interface_constraint(ivars, nograd, &nodes[n]);
+            const double dd = n == edge_trg[e] ? d : -d;
+            cost += w_s * (loss(diff + dd) - loss(diff));
         }
+        return cost;
+    }
 
-        return rc;
+    // round the continuous solution and repair its interface constraints
+    // with unit adjustments along cheapest paths of marginal costs,
+    // one unit of residual at a time from the worst node
+    // returns the number of unit adjustments, or -1 if the repair failed
+    //
+    // /!\ this is a heuristic, not a min-cost flow:
+    //     the simplicity terms couple the edges of a node, so the marginal
+    //     costs change with each move and are only exact for one unit,
+    //     and negative cycles are not canceled, so a path search that
+    //     runs into one fails the repair (repair_optimize then returns
+    //     no integer solution, and the branch and bound starts from
+    //     the plain rounding of the continuous one)
+    EMSCRIPTEN_KEEPALIVE
+    int repair(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        const size_t num_edges = cdata.size();
+        const size_t num_nodes = nodes.size();
+        const index_t NONE = static_cast<index_t>(-1);
+        const index_t prev_iter = curr_iter;
+        curr_iter = 0; // no evaluation logging
+
+        // integer bounds (same as the branch-and-bound search)
+        double lo = HUGE_VAL;
+        double hi = 4;
+        for(const double &val : cdata){
+            lo = std::min(lo, std::floor(val));
+            hi = std::max(hi, std::ceil(val));
+        }
+
+        // round continuous solution
+        ivars.resize(num_edges);
+        for(index_t i = 0; i < num_edges; ++i)
+            ivars[i] = std::max(lo, std::min(hi, std::round(nvars[i])));
+
+        // edge end nodes
+        std::vector<index_t> edge_src(num_edges, NONE);
+        std::vector<index_t> edge_trg(num_edges, NONE);
+        for(const Node &node : nodes){
+            for(index_t e : node.inp_edges)
+                edge_trg[e] = node.index;
+            for(index_t e : node.out_edges)
+                edge_src[e] = node.index;
+        }
+
+        // constraint residuals (inputs - outputs)
+        std::vector<int> residual(num_nodes, 0);
+        const auto update_residuals = [&](){
+            index_t worst = NONE;
+            for(index_t n = 0; n < num_nodes; ++n){
+                if(!nodes[n].has_interface_constraint())
+                    continue;
+                residual[n] = static_cast<int>(std::round(
+                    global_interface_constraint(ivars, nograd, &nodes[n])
+                ));
+                if(residual[n] != 0
+                && (worst == NONE || std::abs(residual[n]) > std::abs(residual[worst])))
+                    worst = n;
+            }
+            return worst;
+        };
+
+        // move one unit of residual at a time from the worst node
+        // to either an unconstrained end or a node of opposite residual
+        //  - a positive residual at node v is reduced by decreasing
+        //    an input edge or increasing an output edge,
+        //    which moves the residual to the other end of that edge
+        //  - a negative residual is moved symmetrically
+        std::vector<double> dist(num_nodes);
+        std::vector<index_t> pred(num_nodes);
+        int num_steps = 0;
+        for(index_t v = update_residuals(); v != NONE; v = update_residuals()){
+            const double s = residual[v] > 0 ? 1 : -1;
+            const auto other_end = [&](index_t e, index_t n){
+                return edge_trg[e] == n ? edge_src[e] : edge_trg[e];
+            };
+            const auto is_terminal = [&](index_t w){
+                return w == NONE
+                    || !nodes[w].has_interface_constraint()
+                    || residual[w] * s < 0;
+            };
+            // relax unit moves (Bellman-Ford)
+            const auto relax = [&](index_t u, auto &&visit){
+                for(index_t e : nodes[u].inp_edges){
+                    if(e != pred[u])
+                        visit(e, -s);
+                }
+                for(index_t e : nodes[u].out_edges){
+                    if(e != pred[u])
+                        visit(e, s);
+                }
+            };
+            dist.assign(num_nodes, HUGE_VAL);
+            pred.assign(num_nodes, NONE);
+            dist[v] = 0;
+            for(index_t round = 0; round < num_nodes; ++round){
+                bool changed = false;
+                for(index_t u = 0; u < num_nodes; ++u){
+                    if(dist[u] == HUGE_VAL || (u != v && is_terminal(u)))
+                        continue;
+                    relax(u, [&](index_t e, double d){
+                        const index_t w = other_end(e, u);
+                        if(w == NONE || w == v)
+                            return;
+                        const double c = repair_step_cost(e, d, lo, hi, edge_src, edge_trg);
+                        if(dist[u] + c < dist[w] - 1e-9){
+                            dist[w] = dist[u] + c;
+                            pred[w] = e;
+                            changed = true;
+                        }
+                    });
+                }
+                if(!changed)
+                    break;
+            }
+            // find best terminal move
+            double best_cost = HUGE_VAL;
+            index_t best_from = NONE;
+            index_t best_edge = NONE;
+            double best_delta = 0;
+            for(index_t u = 0; u < num_nodes; ++u){
+                if(dist[u] == HUGE_VAL || (u != v && is_terminal(u)))
+                    continue;
+                relax(u, [&](index_t e, double d){
+                    const index_t w = other_end(e, u);
+                    if(w != NONE && !is_terminal(w))
+                        return;
+                    const double c = dist[u] + repair_step_cost(e, d, lo, hi, edge_src, edge_trg);
+                    if(c < best_cost){
+                        best_cost = c;
+                        best_from = u;
+                        best_edge = e;
+                        best_delta = d;
+                    }
+                });
+            }
+            // check the path (negative cycles can break it)
+            bool valid = best_edge != NONE;
+            for(index_t u = best_from, len = 0; valid && u != v; ++len){
+                const index_t p = other_end(pred[u], u);
+                valid = len < num_nodes && p != NONE;
+                u = p;
+            }
+            if(!valid){
+                if(verbose)
+                    printf("Repair failed at node #%zu (residual %d)\n", v, residual[v]);
+                curr_iter = prev_iter;
+                return -1;
+            }
+            // apply moves along the path
+            ivars[best_edge] += best_delta;
+            ++num_steps;
+            for(index_t u = best_from; u != v; ){
+                const index_t e = pred[u];
+                const index_t p = other_end(e, u);
+                ivars[e] += edge_trg[e] == p ? -s : s;
+                ++num_steps;
+                u = p;
+            }
+            if(verbose)
+                printf("Repair from node #%zu: cost %g\n", v, best_cost);
+        }
+
+        iobjval = global_sampling(ivars, nograd, NULL);
+        if(verbose)
+            printf("Repaired integer solution: %g after %d adjustments\n", iobjval, num_steps);
+        curr_iter = prev_iter;
+        return num_steps;
     }
 
     // input setters
@@ -866,6 +1489,14 @@ extern "C" {
         global_shaping = gs;
     }
     EMSCRIPTEN_KEEPALIVE
+    void set_multilevel(bool ml){
+        multilevel = ml;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_warm_duals(bool w){
+        warm_duals = w;
+    }
+    EMSCRIPTEN_KEEPALIVE
     void set_aliasing_level(index_t level){
         aliasing_level = static_cast<AliasingLevel>(level);
         aliased = false; // aliasing must be recomputed
@@ -947,6 +1578,47 @@ extern "C" {
         return objval;
     }
     EMSCRIPTEN_KEEPALIVE
+    double get_integer_value(index_t index){
+        return ivars[index];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_integer_objective_value(){
+        return iobjval;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_integer_constraint_error(){
+        return global_constraint_error(ivars);
+    }
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_num_multipliers(){
+        return auglag.lambda.size();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_multiplier(index_t index){
+        return auglag.lambda[index];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_penalty(){
+        return auglag.rho;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_outer_iterations(){
+        return auglag.outer_iters;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void allocate_multipliers(size_t num_multipliers){
+        auglag.lambda.assign(num_multipliers, 0.0);
+        auglag.seeded = true;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_multiplier(index_t index, double value){
+        auglag.lambda[index] = value;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_penalty(double value){
+        auglag.rho = value;
+    }
+    EMSCRIPTEN_KEEPALIVE
     size_t get_num_constraints(){
         size_t num_constraints = 0;
         for(const Node &node : nodes){
@@ -31,7 +31,8 @@ g.nlopt_optimize = function nlopt_optimize(params){
     const numEdges = cdata.length;
     const numNodes = wdata.length;
 
-    // 1 = allocate problem
+    // 1 = allocate problem (growing the memory once)
+    g._reserve(g._plan_capacity(numEdges, numNodes));
     g._allocate(numEdges, numNodes);
 
     // 2 = set problem data
@@ -65,7 +66,9 @@ g.nlopt_optimize = function nlopt_optimize(params){
         ['mainFTolRel', 'main_ftol_rel'],
         ['localFTolRel', 'local_ftol_rel'],
         ['constraintTol', 'constraint_tol'],
-        ['aliasingLevel', 'aliasing_level']
+        ['aliasingLevel', 'aliasing_level'],
+        ['multilevel', 'multilevel'],
+        ['warmDuals', 'warm_duals']
     ]){
         const [name, key] = pair;
         if(name in params){
@@ -75,6 +78,15 @@ g.nlopt_optimize = function nlopt_optimize(params){
         }
     }
 
+    // seed multipliers from a previous solve
+    if(params.duals){
+        const { multipliers, penalty } = params.duals;
+        g._allocate_multipliers(multipliers.length);
+        for(let i = 0; i < multipliers.length; ++i)
+            g._set_multiplier(i, multipliers[i]);
+        g._set_penalty(penalty);
+    }
+
     // 4 = solve the problem
     const now = Date.now();
     const rc = g._solve(verbose);
@@ -87,7 +99,38 @@ g.nlopt_optimize = function nlopt_optimize(params){
     }
     
     // 5 = extract solution
-    return cdata.map((_, i) => {
+    return g.time_readback(() => cdata.map((_, i) => {
         return g._get_variable_value(i);
+    }));
+};
+/**
+ * Solve the relaxed problem and repair its rounding
+ * into an integer-feasible incumbent.
+ *
+ * @return { values, integer, integerError, adjustments }
+ *  where integer is null if the repair failed
+ */
+g.repair_optimize = function repair_optimize(params){
+    const values = g.nlopt_optimize(params);
+    const adjustments = g._repair(!!params.verbose);
+    if(adjustments < 0)
+        return { values, integer: null, integerError: Infinity, adjustments };
+    const integer = values.map((_, i) => {
+        return g._get_integer_value(i);
+    });
+    const integerError = g._get_integer_objective_value();
+    return { values, integer, integerError, adjustments };
+};
+
+/**
+ * Multipliers and penalty weight of the last solve with warmDuals,
+ * which can be passed as params.duals to seed another solve.
+ * Without params.duals, warmDuals only reuses them on the same problem.
+ */
+g.get_duals = function get_duals(){
+    const multipliers = Array.from({ length: g._get_num_multipliers() }, (_, i) => {
+        return g._get_multiplier(i);
     });
-};
\ No newline at end of file
+    const penalty = g._get_penalty();
+    return { multipliers, penalty };
+};
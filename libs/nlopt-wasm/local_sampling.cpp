@@ -8,9 +8,16 @@
 #include "../nlopt/src/api/nlopt.h"
 #include "../nlopt/src/util/nlopt-util.h"
 #include "build/nlopt.hpp"
+#include "copt.h"
+#include "scratch.h"
+#include "auglag.h"
+#include "evals.h"
+#include "../wasm_heap.h"
 
 typedef size_t index_t;
 
+const uint32_t stats_module_id = STATS_LOCAL;
+
 enum bound_t {
     FirstMin = 0,
     FirstMax,
@@ -47,17 +54,55 @@ static double               local_ftol_rel = 1e-3;
 static double               constraint_tol = 1e-1;
 static size_t               seed = 0xDEADBEEF;
 static bool                 gaussian_start = false;
+static size_t               continuation = 0;   // number of shaping stages
+static bool                 warm_duals = false;
 
 // outputs
 static std::vector<double>  nvars;
 static std::vector<double>  ngrad;
 static double               objval;
+static std::vector<size_t>  stage_evals;        // evaluations per stage
 static std::vector<double>  nograd;
 
+// evaluation scratch buffers
+static Scratch              scratch;
+static std::vector<DynamicBoundConstraint> all_constraints; // with first/last
+static std::vector<DynamicBoundConstraint> next_constraints; // without
+static std::vector<double>  ns_min;
+static std::vector<double>  ns_max;
+
+// augmented Lagrangian with persistent multipliers
+static AugLag               auglag;
+
+// optimizer buffers (see COpt)
+static COpt::Buffers        main_buffers;
+static COpt::Buffers        local_buffers;
+
+// integer dynamic programming data
+static std::vector<double>  int_min;    // user integer bounds (NaN = derived)
+static std::vector<double>  int_max;
+static std::vector<double>  dp_lo;      // lowest integer value per variable
+static std::vector<index_t> dp_offsets; // value ranges in dp_from (N + 1)
+static std::vector<double>  dp_cost;    // best partial cost per value
+static std::vector<double>  dp_next;
+static std::vector<index_t> dp_from;    // backpointers (sum of ranges)
+
 inline double loss(double x){
     return x * x;
 }
 
+/**
+ * Signature of the current problem, so that the duals
+ * of the augmented Lagrangian are only reused on the same problem.
+ * F is left out so that the continuation stages of one solve share them.
+ */
+uint64_t problem_signature(){
+    uint64_t h = AugLag::HASH_BASIS;
+    h = AugLag::hash(h, ns_start);
+    h = AugLag::hash(h, ns_end);
+    return AugLag::hash(h, cdata);
+}
+
 // forward declaration
 double local_constraint_error(const std::vector<double> &);
 
@@ -185,12 +230,13 @@ double local_constraint(
     }
 }
 
-std::vector<DynamicBoundConstraint> get_constraints(
+// fill the constraints in place (reusing their buffer across problems)
+void get_constraints(
+    std::vector<DynamicBoundConstraint> &constraints,
     bool use_first = false,
     bool use_last  = false
 ){
     const size_t N = cdata.size();
-    std::vector<DynamicBoundConstraint> constraints;
     if(use_first && use_last)
         constraints.resize(2*N+2);
     else if(use_first || use_last)
@@ -214,24 +260,21 @@ std::vector<DynamicBoundConstraint> get_constraints(
         constraints[c++] = { N-1, LastMin };
         constraints[c++] = { N-1, LastMax };
     }
-    return constraints;
 }
 
-std::vector<double> local_constraint_errors(
+const std::vector<double> &local_constraint_errors(
     const std::vector<double> &ns
 ){
-    const size_t N = ns.size();
-    std::vector<DynamicBoundConstraint> constraints = get_constraints(true, true);
-    std::vector<double> err(N * 2 + 2);
-    for(index_t i = 0; i < N*2+2; ++i)
-        err[i] = local_constraint(ns, nograd, &constraints[i]);
+    std::vector<double> &err = scratch.values;
+    for(index_t i = 0; i < all_constraints.size(); ++i)
+        err[i] = local_constraint(ns, nograd, &all_constraints[i]);
     return err;
 }
 
 double local_constraint_error(
     const std::vector<double> &ns
 ){
-    std::vector<double> err = local_constraint_errors(ns);
+    const std::vector<double> &err = local_constraint_errors(ns);
     double sum = 0.0;
     for(double e : err)
         sum += e;
@@ -241,7 +284,7 @@ double local_constraint_error(
 double local_constraint_max_error(
     const std::vector<double> &ns
 ){
-    std::vector<double> err = local_constraint_errors(ns);
+    const std::vector<double> &err = local_constraint_errors(ns);
     double max = 0.0;
     for(double e : err)
         max = std::max(max, e);
@@ -249,19 +292,21 @@ double local_constraint_max_error(
 }
 
 double get_gradient_error(
-    const std::vector<double> ns,
+    const std::vector<double> &ns,
     nlopt::vfunc f, void *f_data,
     double epsilon,
     bool relative = true
 ){
     double max_err = 0;
     // compute analytical gradient
-    std::vector<double> grad_ana(ns.size());
+    std::vector<double> &grad_ana = scratch.grad_ana;
+    std::fill(grad_ana.begin(), grad_ana.end(), 0.0);
     f(ns, grad_ana, f_data);
 
     // compute numerical gradients for each dimension
     // and accumulate error per dimension
-    std::vector<double> ns_delta = ns; // copy
+    std::vector<double> &ns_delta = scratch.delta;
+    std::copy(ns.begin(), ns.end(), ns_delta.begin());
     for(index_t i = 0; i < cdata.size(); ++i){
         // plus value
         ns_delta[i] = ns[i] + epsilon;
@@ -294,6 +339,130 @@ double get_gradient_error(
     return max_err;
 }
 
+/**
+ * Exact integer solution of the chain by dynamic programming.
+ *
+ * The variables take integer values within their bounds,
+ * and consecutive values must satisfy the shaping ratio
+ *
+ *   ns[i] / F <= ns[i+1] <= ns[i] * F
+ *
+ * including the fixed ns_start and ns_end at both ends.
+ * The cost is O(sum_i K_i * W_i) for K_i values per variable
+ * and W_i valid predecessors per value.
+ *
+ * @return the optimal objective (infinite if no assignment is feasible)
+ */
+double integer_local_sampling(bool verbose){
+    const double inf = std::numeric_limits<double>::infinity();
+    const size_t N = cdata.size();
+    const auto debug = [&verbose](auto&& ...args){
+        if(!verbose)
+            return;
+        printf(args...);
+    };
+    const auto ratio_ok = [](double prev, double next){
+        // same tests as the JS branch and bound
+        return !(next > prev * F || next < prev / F);
+    };
+
+    // integer ranges
+    dp_lo.resize(N);
+    dp_offsets.resize(N + 1);
+    dp_offsets[0] = 0;
+    for(index_t i = 0; i < N; ++i){
+        double lo = int_min[i];
+        double hi = int_max[i];
+        if(std::isnan(lo) || std::isnan(hi)){
+            // same boxes as for the continuous problem
+            double nss_min = std::max(2.0, ns_start * std::pow(iF, i + 1));
+            double nss_max = std::min(1e4, ns_start * std::pow(F, i + 1));
+            double nse_min = std::max(2.0, ns_end * std::pow(iF, N - i));
+            double nse_max = std::min(1e4, ns_end * std::pow(F, N - i));
+            if(std::isnan(lo))
+                lo = std::max(nss_min, nse_min);
+            if(std::isnan(hi))
+                hi = std::min(nss_max, nse_max);
+        }
+        lo = std::ceil(lo);
+        hi = std::floor(hi);
+        if(hi < lo){
+            debug("Empty integer range for %zu: [%g, %g]\n", i, lo, hi);
+            return inf;
+        }
+        dp_lo[i] = lo;
+        dp_offsets[i + 1] = dp_offsets[i] + static_cast<size_t>(hi - lo) + 1;
+        debug("Integer range[%zu]: [%g, %g]\n", i, lo, hi);
+    }
+    dp_from.resize(dp_offsets[N]);
+
+    // first variable (bounded by ns_start)
+    size_t K = dp_offsets[1];
+    dp_cost.resize(K);
+    for(index_t k = 0; k < K; ++k){
+        const double v = dp_lo[0] + k;
+        if(ratio_ok(ns_start, v))
+            dp_cost[k] = w_c * loss(v - cdata[0]) + w_s * loss(v - ns_start);
+        else
+            dp_cost[k] = inf;
+    }
+
+    // next variables
+    for(index_t i = 1; i < N; ++i){
+        const size_t Kp = K;
+        const double lp = dp_lo[i - 1];
+        const double hp = lp + Kp - 1;
+        K = dp_offsets[i + 1] - dp_offsets[i];
+        dp_next.resize(K);
+        for(index_t k = 0; k < K; ++k){
+            const double v = dp_lo[i] + k;
+            // predecessors within the shaping ratio
+            // /!\ the window is widened by one and checked exactly
+            const double p_min = std::max(lp, std::floor(v / F));
+            const double p_max = std::min(hp, std::ceil(v * F));
+            double best = inf;
+            index_t arg = 0;
+            for(double p = p_min; p <= p_max; ++p){
+                const index_t j = static_cast<index_t>(p - lp);
+                if(dp_cost[j] == inf || !ratio_ok(p, v))
+                    continue;
+                const double cost = dp_cost[j] + w_s * loss(p - v);
+                if(cost < best){
+                    best = cost;
+                    arg = j;
+                }
+            }
+            dp_next[k] = best + w_c * loss(v - cdata[i]);
+            dp_from[dp_offsets[i] + k] = arg;
+        }
+        std::swap(dp_cost, dp_next);
+    }
+
+    // last variable (bounded by ns_end)
+    double best = inf;
+    index_t arg = 0;
+    for(index_t k = 0; k < K; ++k){
+        const double v = dp_lo[N - 1] + k;
+        if(dp_cost[k] == inf || !ratio_ok(v, ns_end))
+            continue;
+        const double cost = dp_cost[k] + w_s * loss(v - ns_end);
+        if(cost < best){
+            best = cost;
+            arg = k;
+        }
+    }
+    if(best == inf)
+        return inf;
+
+    // backtrack solution
+    for(index_t i = N - 1; i > 0; --i){
+        nvars[i] = dp_lo[i] + arg;
+        arg = dp_from[dp_offsets[i] + arg];
+    }
+    nvars[0] = dp_lo[0] + arg;
+    return best;
+}
+
 extern "C" {
 
     EMSCRIPTEN_KEEPALIVE
@@ -304,13 +473,50 @@ extern "C" {
 
     EMSCRIPTEN_KEEPALIVE
     void allocate(size_t num_edges){
+        StatsPhaseTimer timer(PHASE_SETUP);
         reset();
         nvars.resize(num_edges);
         ngrad.resize(num_edges);
         cdata.resize(num_edges);
-    }
-
-    void set_nlopt_defaults(nlopt::opt &opt){
+        scratch.allocate(num_edges, 2 * num_edges + 2);
+        // objective and constraints
+        main_buffers.reserve(num_edges, 2 * num_edges + 1);
+        local_buffers.reserve(num_edges, 1);
+        auglag.reserve(num_edges, 2 * num_edges);
+        stage_evals.reserve(std::max<size_t>(1, continuation));
+        if(num_edges){
+            get_constraints(all_constraints, true, true);
+            get_constraints(next_constraints, false, false);
+        }
+        ns_min.resize(num_edges);
+        ns_max.resize(num_edges);
+        int_min.assign(num_edges, std::numeric_limits<double>::quiet_NaN());
+        int_max.assign(num_edges, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    /**
+     * Heap bytes needed by a problem (see reserve in wasm_heap.h)
+     *
+     * The integer solve allocates its value ranges separately,
+     * since they depend on the bounds.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    size_t plan_capacity(size_t num_edges){
+        // per-edge data (cdata, nvars, ngrad, scratch, ns/int bounds)
+        size_t bytes = 11 * vector_bytes<double>(num_edges);
+        // constraint values and the two constraint lists
+        bytes += vector_bytes<double>(2 * num_edges + 2)
+               + vector_bytes<DynamicBoundConstraint>(2 * num_edges + 2)
+               + vector_bytes<DynamicBoundConstraint>(2 * num_edges);
+        // optimizer and augmented Lagrangian buffers
+        bytes += COpt::Buffers::bytes(num_edges, 2 * num_edges + 1)
+               + COpt::Buffers::bytes(num_edges, 1)
+               + vector_bytes<AugLag::Constraint>(2 * num_edges)
+               + 2 * vector_bytes<double>(2 * num_edges);
+        return bytes + COpt::workspace_bytes(num_edges);
+    }
+
+    void set_nlopt_defaults(COpt &opt){
         opt.set_population(0);
         opt.set_initial_step(1.0);
         opt.set_stopval(-HUGE_VAL);
@@ -321,9 +527,9 @@ extern "C" {
         opt.set_vector_storage(0);
     }
 
-    // call solver and return its return code
-    EMSCRIPTEN_KEEPALIVE
-    int solve(bool verbose = false){
+    // solve for the current shaping factor
+    // starting from the previous solution if warm_start is true
+    int solve_stage(bool verbose, bool warm_start, index_t stage){
         // local debug function
         const auto debug = [&verbose](auto&& ...args){
             if(!verbose)
@@ -339,8 +545,8 @@ extern "C" {
 
         // create nlopt optimizer(s)
         const size_t n = nvars.size();
-        nlopt::opt opt(main_algo, n);
-        nlopt::opt local_opt(local_algo, n);
+        COpt opt(main_algo, n, main_buffers);
+        COpt local_opt(local_algo, n, local_buffers);
 
         // defaults
         set_nlopt_defaults(opt);
@@ -362,7 +568,14 @@ extern "C" {
         }
 
         // set optimizer parameters
-        opt.set_min_objective(local_sampling, NULL);
+        opt.set_min_objective(counted_objective<local_sampling>, NULL);
+
+        // own augmented Lagrangian loop for warm-started multipliers
+        const bool own_auglag = warm_duals && (
+            main_algo == nlopt::AUGLAG
+         || main_algo == nlopt::AUGLAG_EQ
+        );
+        auglag.reset_problem(counted_objective<local_sampling>, NULL);
         
         // user defined
         if(main_ftol_rel){
@@ -383,10 +596,8 @@ extern "C" {
         
         // set the problem bounds
         // and record initial value (based on cdata + bounds)
-        std::vector<double> ns_min(n);
-        std::vector<double> ns_max(n);
         for(index_t i = 0; i < n; ++i){
-            double cw = cdata[i];
+            double cw = warm_start ? nvars[i] : cdata[i];
             // box around ns_start
             double nss_min = std::max(2.0, ns_start * std::pow(iF, i + 1));
             double nss_max = std::min(1e4, ns_start * std::pow(F, i + 1));
@@ -410,22 +621,25 @@ extern "C" {
         }
         opt.set_lower_bounds(ns_min);
         opt.set_upper_bounds(ns_max);
+        if(own_auglag){
+            local_opt.set_lower_bounds(ns_min);
+            local_opt.set_upper_bounds(ns_max);
+        }
 
         // add equality constraints
-        std::vector<DynamicBoundConstraint> constraints;
         if(use_constraints){
             // first and last are encoded in variable bounds
             // => no need to add additional constraints for those
-            constraints = get_constraints(false, false);
-            for(DynamicBoundConstraint &constr : constraints){
+            for(DynamicBoundConstraint &constr : next_constraints){
                 opt.add_inequality_constraint(
-                    local_constraint, &constr, constraint_tol
+                    counted_constraint<local_constraint>, &constr, constraint_tol
                 );
+                auglag.add_constraint(counted_constraint<local_constraint>, &constr, false);
             }
         }
 
         // perturb starting point with Gaussian noise
-        if(gaussian_start){
+        if(gaussian_start && !warm_start){
             // perturb starting point with Gaussian noise
             for(index_t i = 0; i < nvars.size(); ++i){
                 nvars[i] = std::max(
@@ -437,7 +651,8 @@ extern "C" {
         }
         
         if(verbose){
-            std::vector<double> grad(n);
+            std::vector<double> &grad = scratch.grad;
+            std::fill(grad.begin(), grad.end(), 0.0);
             double err0 = local_sampling(nvars, grad, NULL);
             printf("Initial error: %g\n", err0);
             for(index_t i = 0; i < n; ++i){
@@ -445,52 +660,102 @@ extern "C" {
             }
         }
 
-        int rc = 0;
-
         // perform optimization
-        try {
-            curr_iter = 1; // start considering iterations
-            nlopt::result res = opt.optimize(nvars, objval);
-
+        curr_iter = 1; // start considering iterations
+        nlopt::result res;
+        if(own_auglag)
+            stats_cache(auglag.prepare(n, true, problem_signature())); // warm duals
+        if(own_auglag){
+            res = auglag.optimize(
+                local_opt, nvars, objval, constraint_tol,
+                main_ftol_rel ? main_ftol_rel : 1e-6,
+                max_eval ? max_eval : 1e3, verbose
+            );
+            debug("Outer iterations: %u\n", auglag.outer_iters);
+        } else {
+            res = opt.optimize(nvars, objval);
             debug("Solved after %u iterations\n", opt.get_numevals());
+        }
 
-            // return the result code as an integer
-            // + positive: success
-            //  1 = generic success
-            //  2 = stopval reached
-            //  3 = ftol reached
-            //  4 = xtol reached
-            //  5 = maxeval reached
-            //  6 = maxtime reached
-            // - negative: error
-            //  -1 = generic failure
-            //  -2 = invalid argument (e.g. bounds or algorithm)
-            //  -3 = out-of-memory
-            //  -4 = roundoff errors limiting progress
-            //  -5 = forced stop
-            rc = static_cast<int>(res);
-
-        } catch (const std::exception& ex) {
-            printf("\nException(ex): %s\n", ex.what());
+        // return the result code as an integer
+        // + positive: success
+        //  1 = generic success
+        //  2 = stopval reached
+        //  3 = ftol reached
+        //  4 = xtol reached
+        //  5 = maxeval reached
+        //  6 = maxtime reached
+        // - negative: error
+        //  -1 = generic failure
+        //  -2 = invalid argument (e.g. bounds or algorithm)
+        //  -3 = out-of-memory
+        //  -4 = roundoff errors limiting progress
+        //  -5 = forced stop
+        const int rc = static_cast<int>(res);
+        if(rc < 0){
+            printf("\nFailed with code %d\n", rc);
             printf("Message: %s\n", opt.get_errmsg());
             printf("After %u iterations\n", opt.get_numevals());
+        }
 
-        } catch (const std::string& ex) {
-            printf("\nException(str): %s\n", ex.c_str());
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+        stage_evals[stage] = own_auglag ? auglag.num_evals : opt.get_numevals();
+        return rc;
+    }
 
-        } catch (...) {
-            printf("\nUnknown exception\n");
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+    // call solver and return its return code
+    // with continuation, the shaping factor goes from loose (F=2)
+    // to its target value over stages, each warm-started
+    // from the solution of the previous one
+    EMSCRIPTEN_KEEPALIVE
+    int solve(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        ALLOC_GUARD();
+        const size_t num_stages = F < 2.0 ? std::max<size_t>(1, continuation) : 1;
+        stage_evals.assign(num_stages, 0);
+        if(num_stages == 1)
+            return solve_stage(verbose, false, 0);
+
+        const double target_F = F;
+        int rc = 0;
+        for(index_t s = 0; s < num_stages; ++s){
+            // geometric interpolation from 2 to the target
+            const double t = double(s) / double(num_stages - 1);
+            F = std::pow(2.0, 1.0 - t) * std::pow(target_F, t);
+            iF = 1.0 / F;
+            if(verbose)
+                printf("Continuation stage %zu: F=%g\n", s, F);
+            rc = solve_stage(verbose, s > 0, s);
+            if(rc <= 0)
+                break; // failed stage
         }
-
+        F = target_F;
+        iF = 1.0 / F;
         return rc;
     }
 
+    // solve the integer problem exactly and return its return code
+    // (FAILURE if no integer assignment satisfies the bounds)
+    EMSCRIPTEN_KEEPALIVE
+    int solve_integer(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        stage_evals.assign(1, 0);
+        if(nvars.empty())
+            return static_cast<int>(nlopt::INVALID_ARGS);
+        objval = integer_local_sampling(verbose);
+        if(verbose)
+            printf("Integer objective: %g\n", objval);
+        if(objval == std::numeric_limits<double>::infinity())
+            return static_cast<int>(nlopt::FAILURE);
+        return static_cast<int>(nlopt::SUCCESS);
+    }
+
     // input setters
     EMSCRIPTEN_KEEPALIVE
+    void set_integer_bounds(index_t index, double min, double max){
+        int_min[index] = min;
+        int_max[index] = max;
+    }
+    EMSCRIPTEN_KEEPALIVE
     void set_cdata(index_t index, double value){
         cdata[index] = value;
     }
@@ -508,6 +773,15 @@ extern "C" {
         iF = 1.0 / F;
     }
     EMSCRIPTEN_KEEPALIVE
+    void set_continuation(size_t stages){
+        continuation = stages;
+        stage_evals.reserve(std::max<size_t>(1, stages));
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_warm_duals(bool w){
+        warm_duals = w;
+    }
+    EMSCRIPTEN_KEEPALIVE
     void set_weights(double wc, double ws){
         w_c = wc;
         w_s = ws;
@@ -589,6 +863,43 @@ extern "C" {
         return objval;
     }
     EMSCRIPTEN_KEEPALIVE
+    size_t get_num_stages(){
+        return stage_evals.size();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_stage_evaluations(index_t stage){
+        return stage_evals[stage];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_num_multipliers(){
+        return auglag.lambda.size();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_multiplier(index_t index){
+        return auglag.lambda[index];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_penalty(){
+        return auglag.rho;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_outer_iterations(){
+        return auglag.outer_iters;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void allocate_multipliers(size_t num_multipliers){
+        auglag.lambda.assign(num_multipliers, 0.0);
+        auglag.seeded = true;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_multiplier(index_t index, double value){
+        auglag.lambda[index] = value;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_penalty(double value){
+        auglag.rho = value;
+    }
+    EMSCRIPTEN_KEEPALIVE
     double get_constraint_error(){
         return local_constraint_error(nvars);
     }
@@ -616,8 +927,7 @@ extern "C" {
         // go over functions
         max_err = std::max(max_err, error_of(local_sampling, NULL));
         // go over constraints
-        std::vector<DynamicBoundConstraint> constraints = get_constraints(false, false);
-        for(DynamicBoundConstraint &constr : constraints){
+        for(DynamicBoundConstraint &constr : next_constraints){
             max_err = std::max(max_err, error_of(
                 local_constraint,
                 static_cast<void *>(&constr)
@@ -12,14 +12,14 @@ class InvalidArgumentError extends Error {
 }
 
 const g = Module;
-g.nlopt_optimize = function nlopt_optimize(params){
+
+function setup_problem(params){
     // extract main data
     const cdata = params.cdata;
     const start = params.start;
     const end   = params.end;
     const shaping = params.shaping || 2.0;
     const weights = params.weights || [1, 0.1];
-    const verbose = !!params.verbose;
 
     // check main parameters{
     if(!cdata)
@@ -29,7 +29,8 @@ g.nlopt_optimize = function nlopt_optimize(params){
 
     const numEdges = cdata.length;
 
-    // 1 = allocate problem
+    // 1 = allocate problem (growing the memory once)
+    g._reserve(g._plan_capacity(numEdges));
     g._allocate(numEdges);
 
     // 2 = set problem data
@@ -39,6 +40,14 @@ g.nlopt_optimize = function nlopt_optimize(params){
     g._set_ns_end(end);
     g._set_shaping(shaping);
     g._set_weights(weights[0], weights[1]);
+}
+
+g.nlopt_optimize = function nlopt_optimize(params){
+    const cdata = params.cdata;
+    const verbose = !!params.verbose;
+
+    // 1-2 = allocate and set problem data
+    setup_problem(params);
 
     // 3 = set potential parameters
     for(const pair of [
@@ -50,7 +59,9 @@ g.nlopt_optimize = function nlopt_optimize(params){
         ['maxTime', 'max_time'],
         ['mainFTolRel', 'main_ftol_rel'],
         ['localFTolRel', 'local_ftol_rel'],
-        ['constraintTol', 'constraint_tol']
+        ['constraintTol', 'constraint_tol'],
+        ['continuation', 'continuation'],
+        ['warmDuals', 'warm_duals']
     ]){
         const [name, key] = pair;
         if(name in params){
@@ -60,6 +71,15 @@ g.nlopt_optimize = function nlopt_optimize(params){
         }
     }
 
+    // seed multipliers from a previous solve
+    if(params.duals){
+        const { multipliers, penalty } = params.duals;
+        g._allocate_multipliers(multipliers.length);
+        for(let i = 0; i < multipliers.length; ++i)
+            g._set_multiplier(i, multipliers[i]);
+        g._set_penalty(penalty);
+    }
+
     // 4 = solve the problem
     const now = Date.now();
     const rc = g._solve(verbose);
@@ -69,10 +89,81 @@ g.nlopt_optimize = function nlopt_optimize(params){
         console.log('Objective: ' + g._get_objective_value());
         console.log('Constraint: ' + g._get_constraint_error());
         console.log('Duration: ' + duration.toFixed(3) + 's');
+        console.log('Stage evaluations: ' + g.stage_evaluations().join(', '));
     }
     
     // 5 = extract solution
-    return cdata.map((_, i) => {
+    return g.time_readback(() => cdata.map((_, i) => {
         return g._get_variable_value(i);
+    }));
+};
+
+/**
+ * Solve the problem exactly over integers by dynamic programming
+ * (instead of rounding the continuous solution).
+ *
+ * Additional parameters:
+ * - min / max: arrays of integer bounds per variable
+ *              (default to the boxes of the continuous problem)
+ *
+ * @return { sn, error } or null if no integer assignment is feasible
+ */
+g.integer_optimize = function integer_optimize(params){
+    const cdata = params.cdata;
+    const verbose = !!params.verbose;
+
+    // 1-2 = allocate and set problem data
+    setup_problem(params);
+
+    // 3 = set integer bounds
+    if(params.min || params.max){
+        for(let i = 0; i < cdata.length; ++i){
+            g._set_integer_bounds(i,
+                params.min ? params.min[i] : NaN,
+                params.max ? params.max[i] : NaN
+            );
+        }
+    }
+
+    // 4 = solve the integer problem
+    const now = Date.now();
+    const rc = g._solve_integer(verbose);
+    if(verbose){
+        const duration = (Date.now() - now) / 1000.0;
+        console.log('Return code: ' + rc);
+        console.log('Objective: ' + g._get_objective_value());
+        console.log('Duration: ' + duration.toFixed(3) + 's');
+    }
+    if(rc < 0)
+        return null;
+
+    // 5 = extract integer solution
+    return g.time_readback(() => ({
+        sn: cdata.map((_, i) => g._get_variable_value(i)),
+        error: g._get_objective_value()
+    }));
+};
+
+/**
+ * Number of objective evaluations for each stage of the last solve
+ * (a single stage unless using continuation)
+ */
+g.stage_evaluations = function stage_evaluations(){
+    const numStages = g._get_num_stages();
+    return Array.from({ length: numStages }, (_, i) => {
+        return g._get_stage_evaluations(i);
+    });
+};
+
+/**
+ * Multipliers and penalty weight of the last solve with warmDuals,
+ * which can be passed as params.duals to seed another solve.
+ * Without params.duals, warmDuals only reuses them on the same problem.
+ */
+g.get_duals = function get_duals(){
+    const multipliers = Array.from({ length: g._get_num_multipliers() }, (_, i) => {
+        return g._get_multiplier(i);
     });
-};
\ No newline at end of file
+    const penalty = g._get_penalty();
+    return { multipliers, penalty };
+};
@@ -0,0 +1,82 @@
+#ifndef NLOPT_WASM_SCRATCH_H
+#define NLOPT_WASM_SCRATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+/**
+ * Scratch buffers of a module, sized at allocation time
+ * and reused by all objective, constraint and diagnostic evaluations
+ * so that no evaluation needs to allocate on the (slow) wasm heap.
+ */
+struct Scratch {
+    std::vector<double> vars;   // unreduced variables
+    std::vector<double> grad;   // unreduced gradient
+    std::vector<double> delta;  // perturbed variables (gradient check)
+    std::vector<double> grad_ana; // analytical gradient (gradient check)
+    std::vector<double> values; // per-constraint values
+
+    void allocate(size_t num_vars, size_t num_values = 0){
+        vars.resize(num_vars);
+        grad.resize(num_vars);
+        delta.resize(num_vars);
+        grad_ana.resize(num_vars);
+        values.resize(num_values);
+    }
+};
+
+/**
+ * Debug heap allocation counter (compile with -DDEBUG_ALLOCS).
+ *
+ * Counts C++ heap allocations, which is used to assert that
+ * a solve does not allocate from its entry to its exit.
+ * The structures built on the first solve of a problem and cached
+ * across solves (e.g. aliases, coarse graph) are setup work
+ * and their allocations are excluded with ALLOC_SETUP.
+ * nlopt's own workspace is allocated with malloc and is not counted.
+ */
+#ifdef DEBUG_ALLOCS
+#include <assert.h>
+
+static size_t heap_allocs = 0;
+static size_t setup_allocs = 0;
+
+void* operator new(size_t size){
+    ++heap_allocs;
+    if(void *ptr = malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+// asserts that its scope does not allocate (except for setup scopes)
+struct AllocGuard {
+    const size_t allocs = heap_allocs;
+    const size_t setup = setup_allocs;
+    ~AllocGuard(){
+        const size_t count = (heap_allocs - allocs) - (setup_allocs - setup);
+        if(count)
+            printf("Heap allocations during solve: %zu\n", count);
+        assert(count == 0);
+    }
+};
+// counts the allocations of its scope as setup work (must not be nested)
+struct AllocSetup {
+    const size_t allocs = heap_allocs;
+    ~AllocSetup(){
+        setup_allocs += heap_allocs - allocs;
+    }
+};
+
+#define ALLOC_GUARD() AllocGuard alloc_guard
+#define ALLOC_SETUP() AllocSetup alloc_setup
+#else
+#define ALLOC_GUARD()
+#define ALLOC_SETUP()
+#endif
+
+#endif
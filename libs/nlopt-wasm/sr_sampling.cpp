@@ -1,5 +1,4 @@
 #include <emscripten.h>
-#include <emscripten/bind.h> 
 #include <algorithm>
 #include <limits.h>
 #include <string>
@@ -9,13 +8,20 @@
 #include "../nlopt/src/api/nlopt.h"
 #include "../nlopt/src/util/nlopt-util.h"
 #include "build/nlopt.hpp"
+#include "copt.h"
+#include "scratch.h"
+#include "evals.h"
+#include "../wasm_heap.h"
 
 typedef size_t index_t;
+typedef int dptr_t;
+
+const uint32_t stats_module_id = STATS_SR;
 
 // inputs
 static std::vector<double>  cdata;
 static bool                 circular;
-static bool                 simp_L2 = true;
+static int                  simp_power = 2;
 static double               w_w = 1;
 static double               w_s = 0.1;
 
@@ -38,6 +44,55 @@ static std::vector<double>  ngrad;
 static double               objval;
 static std::vector<double>  nograd;
 
+// evaluation scratch buffers
+static Scratch              scratch;
+
+// integer solver data
+static std::vector<double>  dp_cost;    // best partial cost per value
+static std::vector<double>  dp_conv;    // min-convolution of dp_cost
+static std::vector<index_t> dp_arg;     // argmin of the min-convolution
+static std::vector<index_t> dp_from;    // backpointers (N x K)
+static std::vector<index_t> dp_env;     // lower envelope parabolas (L2)
+static std::vector<double>  dp_bnd;     // lower envelope boundaries (L2)
+
+// optimizer buffers (see COpt)
+static COpt::Buffers        main_buffers;
+static COpt::Buffers        local_buffers;
+
+// total variation solver data
+static std::vector<double>  tv_input;   // shifted data for the path problem
+
+// alignment inputs
+static std::vector<double>  src_xy;     // source sample coordinates (x,y)
+static std::vector<double>  trg_xy;     // target sample coordinates (x,y)
+static std::vector<double>  src_curv;   // source sample curvature
+static std::vector<double>  trg_curv;   // target sample curvature
+static double               wale_dist = 1;
+static size_t               band_radius = 0;    // 0 = no band
+static size_t               max_reuse = 0;      // 0 = unconstrained
+static const size_t         shift_radius = 4;   // circular shifts warped around the linear one
+
+// alignment data and outputs
+static std::vector<double>  dtw_cost;   // accumulated cost (M x N)
+static std::vector<uint8_t> dtw_src_use; // source reuse count (M x N)
+static std::vector<uint8_t> dtw_trg_use; // target reuse count (M x N)
+static std::vector<uint8_t> dtw_step;    // backpointer of each cell (M x N)
+static std::vector<index_t> mapping;    // target index of each source
+static std::vector<double>  align_dist; // distance of each source to its target
+static double               align_cost = 0;
+
+// batch inputs (packed rows)
+static std::vector<double>  batch_cdata;    // concatenated cdata of all rows
+static std::vector<int32_t> batch_offsets;  // row offsets (num_rows + 1)
+static std::vector<uint8_t> batch_circular; // circular flag per row
+static std::vector<uint8_t> batch_power;    // simplicity power per row
+static std::vector<double>  batch_weights;  // (w_w, w_s) per row
+
+// batch outputs
+static std::vector<double>  batch_output;   // concatenated solutions
+static std::vector<double>  batch_objval;   // objective per row
+static std::vector<int32_t> batch_rc;       // return code per row
+
 inline double loss(double x){
     return x * x;
 }
@@ -48,7 +103,7 @@ inline double simplicity(
     size_t i0, size_t i1
 ){
     double diff = ns[i0] - ns[i1];
-    if(simp_L2){
+    if(simp_power == 2){
         // L2 simplicity
         // dEs = (ns[i0] - ns[i1])^2
         if(grad.size()){
@@ -62,8 +117,8 @@ inline double simplicity(
         // dEs = |ns[i0] - ns[i1]|
         double sign = diff >= 0 ? 1 : -1;
         if(grad.size()){
-            grad[i0] = w_s * sign;
-            grad[i1] = -w_s * sign;
+            grad[i0] += w_s * sign;
+            grad[i1] -= w_s * sign;
         }
         return sign * diff;
     }
@@ -107,19 +162,21 @@ double rs_sampling(
 }
 
 double get_gradient_error(
-    const std::vector<double> ns,
+    const std::vector<double> &ns,
     nlopt::vfunc f, void *f_data,
     double epsilon,
     bool relative = true
 ){
     double max_err = 0;
     // compute analytical gradient
-    std::vector<double> grad_ana(ns.size());
+    std::vector<double> &grad_ana = scratch.grad_ana;
+    std::fill(grad_ana.begin(), grad_ana.end(), 0.0);
     f(ns, grad_ana, f_data);
 
     // compute numerical gradients for each dimension
     // and accumulate error per dimension
-    std::vector<double> ns_delta = ns; // copy
+    std::vector<double> &ns_delta = scratch.delta;
+    std::copy(ns.begin(), ns.end(), ns_delta.begin());
     for(index_t i = 0; i < cdata.size(); ++i){
         // plus value
         ns_delta[i] = ns[i] + epsilon;
@@ -152,14 +209,459 @@ double get_gradient_error(
     return max_err;
 }
 
-std::string getExceptionMessage(intptr_t exceptionPtr) {
-    return std::string(reinterpret_cast<std::exception *>(exceptionPtr)->what());
+inline double int_simplicity(double diff){
+    switch(simp_power){
+        case 0:  return diff != 0 ? 1 : 0;
+        case 1:  return std::abs(diff);
+        default: return loss(diff);
+    }
+}
+
+/**
+ * Min-convolution of the partial costs with the simplicity term
+ *
+ *   dp_conv[k] = min_j dp_cost[j] + w_s * simp(k - j)
+ *
+ * computed in O(K) for all simplicity powers:
+ * - L0 uses the global minimum
+ * - L1 uses a two-pass distance transform
+ * - L2 uses the lower envelope of parabolas
+ */
+void min_convolution(size_t K){
+    const double inf = std::numeric_limits<double>::infinity();
+    const double ws = std::max(0.0, w_s);
+    if(simp_power == 0 || ws == 0){
+        // L0: either keep the same value, or pay a unit penalty
+        index_t best = 0;
+        for(index_t k = 1; k < K; ++k){
+            if(dp_cost[k] < dp_cost[best])
+                best = k;
+        }
+        for(index_t k = 0; k < K; ++k){
+            if(dp_cost[k] <= dp_cost[best] + ws){
+                dp_conv[k] = dp_cost[k];
+                dp_arg[k] = k;
+            } else {
+                dp_conv[k] = dp_cost[best] + ws;
+                dp_arg[k] = best;
+            }
+        }
+
+    } else if(simp_power == 1){
+        // L1: forward and backward passes
+        for(index_t k = 0; k < K; ++k){
+            dp_conv[k] = dp_cost[k];
+            dp_arg[k] = k;
+        }
+        for(index_t k = 1; k < K; ++k){
+            if(dp_conv[k-1] + ws < dp_conv[k]){
+                dp_conv[k] = dp_conv[k-1] + ws;
+                dp_arg[k] = dp_arg[k-1];
+            }
+        }
+        for(index_t k = K - 1; k > 0; --k){
+            if(dp_conv[k] + ws < dp_conv[k-1]){
+                dp_conv[k-1] = dp_conv[k] + ws;
+                dp_arg[k-1] = dp_arg[k];
+            }
+        }
+
+    } else {
+        // L2: lower envelope of parabolas ws * (k - j)^2 + dp_cost[j]
+        const auto intersect = [ws](index_t q, index_t v){
+            double fq = dp_cost[q] + ws * q * q;
+            double fv = dp_cost[v] + ws * v * v;
+            return (fq - fv) / (2.0 * ws * (double(q) - double(v)));
+        };
+        size_t num = 0;
+        for(index_t q = 0; q < K; ++q){
+            if(dp_cost[q] == inf)
+                continue; // infeasible value
+            if(num == 0){
+                dp_env[0] = q;
+                dp_bnd[0] = -inf;
+                dp_bnd[1] = inf;
+                num = 1;
+                continue;
+            }
+            double s = intersect(q, dp_env[num - 1]);
+            while(num > 1 && s <= dp_bnd[num - 1]){
+                --num;
+                s = intersect(q, dp_env[num - 1]);
+            }
+            dp_env[num] = q;
+            dp_bnd[num] = s;
+            dp_bnd[num + 1] = inf;
+            ++num;
+        }
+        if(num == 0){
+            // nothing is feasible
+            dp_conv.assign(K, inf);
+            return;
+        }
+        for(index_t k = 0, e = 0; k < K; ++k){
+            while(dp_bnd[e + 1] < k)
+                ++e;
+            const index_t j = dp_env[e];
+            dp_conv[k] = dp_cost[j] + ws * loss(double(k) - double(j));
+            dp_arg[k] = j;
+        }
+    }
+}
+
+/**
+ * Viterbi recursion over the chain of samples, with values in [lo, lo+K).
+ *
+ * @param v0 the conditioned first value index (or K for a free first value)
+ * @param lo the integer value of index 0
+ * @param K the number of integer values
+ * @param track whether to backtrack the solution into nvars
+ * @return the optimal cost of the chain (including the cycle term if circular)
+ */
+double integer_chain(index_t v0, double lo, size_t K, bool track){
+    const double inf = std::numeric_limits<double>::infinity();
+    const size_t N = cdata.size();
+    const auto unary = [lo](index_t i, index_t k){
+        return w_w * loss(lo + k - cdata[i]);
+    };
+
+    // first sample
+    for(index_t k = 0; k < K; ++k){
+        if(v0 == K || v0 == k)
+            dp_cost[k] = unary(0, k);
+        else
+            dp_cost[k] = inf;
+    }
+
+    // next samples
+    for(index_t i = 1; i < N; ++i){
+        min_convolution(K);
+        for(index_t k = 0; k < K; ++k){
+            dp_cost[k] = dp_conv[k] + unary(i, k);
+            dp_from[i * K + k] = dp_arg[k];
+        }
+    }
+
+    // last sample (closing the cycle if circular)
+    index_t best = 0;
+    double best_cost = inf;
+    for(index_t k = 0; k < K; ++k){
+        double cost = dp_cost[k];
+        if(v0 < K)
+            cost += w_s * int_simplicity(double(k) - double(v0));
+        if(cost < best_cost){
+            best_cost = cost;
+            best = k;
+        }
+    }
+
+    // backtrack solution
+    if(track && best_cost < inf){
+        index_t k = best;
+        for(index_t i = N - 1; i > 0; --i){
+            nvars[i] = lo + k;
+            k = dp_from[i * K + k];
+        }
+        nvars[0] = lo + k;
+    }
+    return best_cost;
+}
+
+/**
+ * Direct 1D total variation denoising on a path
+ *
+ *   output = argmin_x 1/2 sum_i (x[i] - input[i])^2 + lambda sum_i |x[i+1] - x[i]|
+ *
+ * using the taut-string algorithm of Condat (2013)
+ * "A Direct Algorithm for 1D Total Variation Denoising".
+ * Linear time in practice, exact up to floating point.
+ */
+void tv_denoise_path(
+    const std::vector<double>   &input,
+    std::vector<double>         &output,
+    double                      lambda
+){
+    const int N = static_cast<int>(input.size());
+    if(N == 0)
+        return;
+    const double lambda2 = 2.0 * lambda;
+    const double mlambda = -lambda;
+    int k = 0, k0 = 0, kplus = 0, kminus = 0;
+    double umin = lambda, umax = mlambda;
+    double vmin = input[0] - lambda, vmax = input[0] + lambda;
+    for(;;){
+        while(k == N - 1){
+            if(umin < 0.0){
+                do output[k0++] = vmin; while(k0 <= kminus);
+                vmin = input[kminus = k = k0];
+                umin = lambda;
+                umax = vmin + umin - vmax;
+            } else if(umax > 0.0){
+                do output[k0++] = vmax; while(k0 <= kplus);
+                vmax = input[kplus = k = k0];
+                umax = mlambda;
+                umin = vmax + umax - vmin;
+            } else {
+                vmin += umin / (k - k0 + 1);
+                do output[k0++] = vmin; while(k0 <= k);
+                return;
+            }
+        }
+        if((umin += input[k + 1] - vmin) < mlambda){
+            do output[k0++] = vmin; while(k0 <= kminus);
+            vmin = input[kplus = kminus = k = k0];
+            vmax = vmin + lambda2;
+            umin = lambda;
+            umax = mlambda;
+        } else if((umax += input[k + 1] - vmax) > lambda){
+            do output[k0++] = vmax; while(k0 <= kplus);
+            vmax = input[kplus = kminus = k = k0];
+            vmin = vmax - lambda2;
+            umin = lambda;
+            umax = mlambda;
+        } else {
+            ++k;
+            if(umin >= lambda){
+                vmin += (umin - lambda) / ((kminus = k) - k0 + 1);
+                umin = lambda;
+            }
+            if(umax <= mlambda){
+                vmax += (umax + lambda) / ((kplus = k) - k0 + 1);
+                umax = mlambda;
+            }
+        }
+    }
 }
 
-EMSCRIPTEN_BINDINGS(Bindings) {
-  emscripten::function("getExceptionMessage", &getExceptionMessage);
+/**
+ * 1D total variation denoising on a cycle
+ *
+ * The cyclic term lambda |x[0] - x[N-1]| is dualized as u (x[0] - x[N-1])
+ * with |u| <= lambda, which turns the problem into a path problem
+ * with shifted endpoints. The dual is concave in u with derivative
+ * x[0](u) - x[N-1](u) (monotonically decreasing), so the optimal u
+ * is found by bisection over [-lambda, lambda].
+ */
+void tv_denoise_cycle(
+    const std::vector<double>   &input,
+    std::vector<double>         &output,
+    double                      lambda
+){
+    const size_t N = input.size();
+    tv_input.assign(input.begin(), input.end());
+    const auto path_with = [&](double u){
+        tv_input[0]     = input[0] - u;
+        tv_input[N - 1] = input[N - 1] + u;
+        tv_denoise_path(tv_input, output, lambda);
+        return output[0] - output[N - 1];
+    };
+    // check saturated cases
+    if(path_with(lambda) >= 0)
+        return;
+    if(path_with(-lambda) <= 0)
+        return;
+    // bisection on the dual variable
+    double u_lo = -lambda, u_hi = lambda;
+    for(index_t it = 0; it < 64 && u_hi - u_lo > 1e-12 * lambda; ++it){
+        double u = 0.5 * (u_lo + u_hi);
+        if(path_with(u) > 0)
+            u_lo = u;
+        else
+            u_hi = u;
+    }
+    path_with(0.5 * (u_lo + u_hi));
+}
+
+inline double sample_dist(index_t si, index_t ti){
+    double dx = src_xy[si * 2 + 0] - trg_xy[ti * 2 + 0];
+    double dy = src_xy[si * 2 + 1] - trg_xy[ti * 2 + 1];
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// backpointers of the alignment path
+enum DTWStep : uint8_t {
+    STEP_BOTH   = 0, // new source and target
+    STEP_TARGET = 1, // reuse target (from the previous source)
+    STEP_SOURCE = 2  // reuse source (from the previous target)
 };
 
+/**
+ * Dynamic time warping between sources and (shifted) targets
+ *
+ * Uses a Sakoe-Chiba band around the diagonal if band_radius > 0,
+ * in which case only the cells of the band are visited,
+ * and limits consecutive reuses of a same source or target
+ * (except the first and last) if max_reuse > 0.
+ *
+ * @param shift the target index matched with the first source
+ * @param track whether to backtrack the alignment into mapping
+ * @return the total alignment cost
+ */
+double dtw_align(index_t shift, bool track){
+    const double inf = std::numeric_limits<double>::infinity();
+    const size_t M = src_curv.size();
+    const size_t N = trg_curv.size();
+    const auto trg = [shift, N](index_t j){
+        return (j + shift) % N;
+    };
+    const auto at = [N](index_t i, index_t j){
+        return i * N + j;
+    };
+
+    // band around the diagonal (large enough to keep rows connected)
+    const double slope = M > 1 ? double(N - 1) / double(M - 1) : double(N);
+    const double radius = band_radius ? std::max(
+        double(band_radius), std::ceil(slope)
+    ) : inf;
+    const auto in_band = [&](index_t i, index_t j){
+        return std::abs(i * slope - j) <= radius;
+    };
+    // cost of a previous cell (outside of the band = unreachable)
+    const auto cost_at = [&](index_t i, index_t j){
+        return in_band(i, j) ? dtw_cost[at(i, j)] : inf;
+    };
+
+    for(index_t i = 0; i < M; ++i){
+        // columns of the band on this row
+        index_t j0 = 0, j1 = N;
+        if(band_radius){
+            j0 = index_t(std::max(0.0, std::ceil(i * slope - radius)));
+            j1 = index_t(std::min(double(N), std::floor(i * slope + radius) + 1));
+        }
+        for(index_t j = j0; j < j1; ++j){
+            const index_t ij = at(i, j);
+            dtw_src_use[ij] = dtw_trg_use[ij] = 1;
+            dtw_step[ij] = STEP_BOTH;
+            if((i || j) && !in_band(i, j)){
+                dtw_cost[ij] = inf;
+                continue;
+            }
+            const double d = sample_dist(i, trg(j));
+            if(i == 0 && j == 0){
+                dtw_cost[ij] = d;
+                continue;
+            }
+            // past options
+            // - reuse source (new target)
+            // - reuse target (new source)
+            // - new source and target
+            double c_src = j > 0 ? cost_at(i, j - 1) : inf;
+            double c_trg = i > 0 ? cost_at(i - 1, j) : inf;
+            double c_both = i > 0 && j > 0 ? cost_at(i - 1, j - 1) : inf;
+            if(max_reuse && i > 0 && j > 0){
+                // /!\ can always reuse the last source / target
+                if(i + 1 < M && c_src < inf && dtw_src_use[at(i, j - 1)] >= max_reuse)
+                    c_src = inf;
+                if(j + 1 < N && c_trg < inf && dtw_trg_use[at(i - 1, j)] >= max_reuse)
+                    c_trg = inf;
+            }
+            if(c_both <= c_src && c_both <= c_trg){
+                dtw_cost[ij] = d + c_both;
+            } else if(c_trg <= c_src){
+                dtw_cost[ij] = d + c_trg;
+                dtw_trg_use[ij] = std::min(255, dtw_trg_use[at(i - 1, j)] + 1);
+                dtw_step[ij] = STEP_TARGET;
+            } else {
+                dtw_cost[ij] = d + c_src;
+                dtw_src_use[ij] = std::min(255, dtw_src_use[at(i, j - 1)] + 1);
+                dtw_step[ij] = STEP_SOURCE;
+            }
+        }
+    }
+    const double cost = cost_at(M - 1, N - 1);
+    if(!track || cost == inf)
+        return cost;
+
+    // trace path backward from the forward decisions
+    // /!\ the costs alone do not account for the reuse limits
+    index_t i = M - 1, j = N - 1;
+    mapping[i] = trg(j);
+    while(i > 0 || j > 0){
+        const DTWStep step = i == 0 ? STEP_SOURCE
+                           : j == 0 ? STEP_TARGET
+                           : static_cast<DTWStep>(dtw_step[at(i, j)]);
+        if(step == STEP_SOURCE){
+            --j;
+            continue; // same source
+        }
+        --i;
+        if(step == STEP_BOTH)
+            --j;
+        // keep the last match of each source
+        mapping[i] = trg(j);
+    }
+    return cost;
+}
+
+/**
+ * Circular alignment
+ *
+ * Each target shift is first scored by the linear matching
+ * of the sources along the shifted targets in O(M).
+ * The warping then only runs for the shifts around the best one,
+ * so that the alignment costs O(M N) instead of O(M N^2)
+ * with one warping per shift.
+ *
+ * @return the total alignment cost
+ */
+double dtw_align_cyclic(){
+    const size_t M = src_curv.size();
+    const size_t N = trg_curv.size();
+    const double step = double(N) / double(M);
+    index_t linear = 0;
+    double linear_cost = std::numeric_limits<double>::infinity();
+    for(index_t shift = 0; shift < N; ++shift){
+        double cost = 0;
+        for(index_t i = 0; i < M && cost < linear_cost; ++i){
+            const index_t j = index_t(std::round(i * step)) + shift;
+            cost += sample_dist(i, j % N);
+        }
+        if(cost < linear_cost){
+            linear_cost = cost;
+            linear = shift;
+        }
+    }
+
+    // warping around the linear shift
+    // (the linear and warped optima are rarely more than a few shifts apart)
+    const size_t radius = std::min(shift_radius, (N - 1) / 2);
+    index_t best = linear;
+    double best_cost = std::numeric_limits<double>::infinity();
+    for(index_t k = 0; k <= 2 * radius; ++k){
+        const index_t shift = (linear + N - radius + k) % N;
+        const double cost = dtw_align(shift, false);
+        if(cost < best_cost){
+            best_cost = cost;
+            best = shift;
+        }
+    }
+    return dtw_align(best, true);
+}
+
+/**
+ * Expected short-row counts from the alignment
+ *
+ *   cdata[i] = d(s_i, t_m(i)) / (D_w * k_i) - 1
+ *
+ * with distances smoothed by a centered average
+ * and k_i the average curvature of both samples.
+ */
+void cdata_from_mapping(){
+    const size_t M = src_curv.size();
+    std::vector<double> &dist = align_dist;
+    dist.resize(M);
+    for(index_t i = 0; i < M; ++i)
+        dist[i] = sample_dist(i, mapping[i]);
+    for(index_t i = 0; i < M; ++i){
+        double d = dist[i];
+        if(circular || (i > 0 && i + 1 < M)){
+            d = (dist[i] + dist[(i + M - 1) % M] + dist[(i + 1) % M]) / 3.0;
+        }
+        const double k = 0.5 * (src_curv[i] + trg_curv[mapping[i]]);
+        cdata[i] = d / (k * wale_dist) - 1;
+    }
+}
+
 extern "C" {
 
     EMSCRIPTEN_KEEPALIVE
@@ -170,13 +672,53 @@ extern "C" {
 
     EMSCRIPTEN_KEEPALIVE
     void allocate(size_t num_samples){
+        StatsPhaseTimer timer(PHASE_SETUP);
         reset();
         nvars.resize(num_samples);
         ngrad.resize(num_samples);
         cdata.resize(num_samples);
+        scratch.allocate(num_samples);
+        main_buffers.reserve(num_samples, 1);
+        local_buffers.reserve(num_samples, 1);
+        tv_input.reserve(num_samples);
+    }
+
+    /**
+     * Heap bytes needed by a problem (see reserve in wasm_heap.h)
+     *
+     * @param num_samples the number of samples (over all rows of a batch)
+     * @param num_rows the number of batch rows (0 without batch)
+     */
+    EMSCRIPTEN_KEEPALIVE
+    size_t plan_capacity(size_t num_samples, size_t num_rows){
+        // problem data (cdata, nvars, ngrad, scratch, tv_input)
+        size_t bytes = 8 * vector_bytes<double>(num_samples)
+                     + 2 * COpt::Buffers::bytes(num_samples, 1)
+                     + COpt::workspace_bytes(num_samples);
+        // batch data
+        if(num_rows){
+            bytes += 2 * vector_bytes<double>(num_samples)
+                   + 3 * vector_bytes<double>(num_rows)
+                   + 2 * vector_bytes<int32_t>(num_rows + 1)
+                   + 2 * vector_bytes<uint8_t>(num_rows);
+        }
+        return bytes;
     }
 
-    void set_nlopt_defaults(nlopt::opt &opt){
+    /**
+     * Heap bytes needed by an alignment problem (see solve_aligned)
+     */
+    EMSCRIPTEN_KEEPALIVE
+    size_t plan_alignment_capacity(size_t num_sources, size_t num_targets){
+        const size_t MN = num_sources * num_targets;
+        return plan_capacity(num_sources, 0)
+             + 3 * vector_bytes<double>(num_sources + num_targets)
+             + vector_bytes<double>(MN)
+             + 3 * vector_bytes<uint8_t>(MN)
+             + 2 * vector_bytes<index_t>(num_sources);
+    }
+
+    void set_nlopt_defaults(COpt &opt){
         opt.set_population(0);
         opt.set_initial_step(1.0);
         opt.set_stopval(-HUGE_VAL);
@@ -187,9 +729,33 @@ extern "C" {
         opt.set_vector_storage(0);
     }
 
+    // solve L1 simplicity problem as total variation denoising
+    int solve_total_variation(bool verbose){
+        const size_t N = cdata.size();
+        // w_w sum (x - c)^2 + w_s TV(x)
+        // <=> 1/2 sum (x - c)^2 + w_s / (2 w_w) TV(x)
+        const double lambda = w_s / (2.0 * w_w);
+        if(circular && N > 1)
+            tv_denoise_cycle(cdata, nvars, lambda);
+        else
+            tv_denoise_path(cdata, nvars, lambda);
+
+        // non-negativity bound
+        // /!\ the clamped TV solution is the solution of the bounded problem
+        for(index_t i = 0; i < N; ++i)
+            nvars[i] = std::max(0.0, nvars[i]);
+
+        objval = rs_sampling(nvars, nograd, NULL);
+        if(verbose)
+            printf("Total variation objective: %g (lambda=%g)\n", objval, lambda);
+        return static_cast<int>(nlopt::SUCCESS);
+    }
+
     // call solver and return its return code
     EMSCRIPTEN_KEEPALIVE
     int solve(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        ALLOC_GUARD();
         // local debug function
         const auto debug = [&verbose](auto&& ...args){
             if(!verbose)
@@ -197,6 +763,18 @@ extern "C" {
             printf(args...);
         };
 
+        // L0 simplicity has no continuous relaxation
+        if(simp_power == 0){
+            printf("Power 0 requires the integer solver\n");
+            return static_cast<int>(nlopt::INVALID_ARGS);
+        }
+
+        // L1 simplicity is solved directly (nonsmooth for quasi-Newton)
+        if(simp_power == 1 && w_w > 0 && w_s > 0){
+            curr_iter = 0;
+            return solve_total_variation(verbose);
+        }
+
         // reset seed
         nlopt::srand(seed);
 
@@ -205,8 +783,8 @@ extern "C" {
 
         // create nlopt optimizer(s)
         const size_t n = nvars.size();
-        nlopt::opt opt(main_algo, n);
-        nlopt::opt local_opt(local_algo, n);
+        COpt opt(main_algo, n, main_buffers);
+        COpt local_opt(local_algo, n, local_buffers);
 
         // defaults
         set_nlopt_defaults(opt);
@@ -228,7 +806,7 @@ extern "C" {
         }
 
         // set optimizer parameters
-        opt.set_min_objective(rs_sampling, NULL);
+        opt.set_min_objective(counted_objective<rs_sampling>, NULL);
         
         // user defined
         if(main_ftol_rel){
@@ -265,7 +843,8 @@ extern "C" {
         }
         
         if(verbose){
-            std::vector<double> grad(n);
+            std::vector<double> &grad = scratch.grad;
+            std::fill(grad.begin(), grad.end(), 0.0);
             double err0 = rs_sampling(nvars, grad, NULL);
             printf("Initial error: %g\n", err0);
             for(index_t i = 0; i < n; ++i){
@@ -273,43 +852,29 @@ extern "C" {
             }
         }
 
-        int rc = 0;
-
         // perform optimization
-        try {
-            curr_iter = 1; // start considering iterations
-            nlopt::result res = opt.optimize(nvars, objval);
-
-            debug("Solved after %u iterations\n", opt.get_numevals());
-
-            // return the result code as an integer
-            // + positive: success
-            //  1 = generic success
-            //  2 = stopval reached
-            //  3 = ftol reached
-            //  4 = xtol reached
-            //  5 = maxeval reached
-            //  6 = maxtime reached
-            // - negative: error
-            //  -1 = generic failure
-            //  -2 = invalid argument (e.g. bounds or algorithm)
-            //  -3 = out-of-memory
-            //  -4 = roundoff errors limiting progress
-            //  -5 = forced stop
-            rc = static_cast<int>(res);
-
-        } catch (const std::exception& ex) {
-            printf("\nException(ex): %s\n", ex.what());
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+        curr_iter = 1; // start considering iterations
+        nlopt::result res = opt.optimize(nvars, objval);
 
-        } catch (const std::string& ex) {
-            printf("\nException(str): %s\n", ex.c_str());
-            printf("Message: %s\n", opt.get_errmsg());
-            printf("After %u iterations\n", opt.get_numevals());
+        debug("Solved after %u iterations\n", opt.get_numevals());
 
-        } catch (...) {
-            printf("\nUnknown exception\n");
+        // return the result code as an integer
+        // + positive: success
+        //  1 = generic success
+        //  2 = stopval reached
+        //  3 = ftol reached
+        //  4 = xtol reached
+        //  5 = maxeval reached
+        //  6 = maxtime reached
+        // - negative: error
+        //  -1 = generic failure
+        //  -2 = invalid argument (e.g. bounds or algorithm)
+        //  -3 = out-of-memory
+        //  -4 = roundoff errors limiting progress
+        //  -5 = forced stop
+        const int rc = static_cast<int>(res);
+        if(rc < 0){
+            printf("\nFailed with code %d\n", rc);
             printf("Message: %s\n", opt.get_errmsg());
             printf("After %u iterations\n", opt.get_numevals());
         }
@@ -317,8 +882,243 @@ extern "C" {
         return rc;
     }
 
+    // call exact integer solver and return a result code
+    EMSCRIPTEN_KEEPALIVE
+    int solve_integer(bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true);
+        // local debug function
+        const auto debug = [&verbose](auto&& ...args){
+            if(!verbose)
+                return;
+            printf(args...);
+        };
+
+        const size_t N = cdata.size();
+        if(N == 0)
+            return static_cast<int>(nlopt::INVALID_ARGS);
+
+        // range of integer values
+        // /!\ clamping to [floor(min c), ceil(max c)] never increases
+        //     the accuracy or the simplicity terms, so the optimum is within
+        double c_min = cdata[0];
+        double c_max = cdata[0];
+        for(double c : cdata){
+            c_min = std::min(c_min, c);
+            c_max = std::max(c_max, c);
+        }
+        const double lo = std::max(0.0, std::floor(c_min));
+        const double hi = std::max(lo, std::ceil(c_max));
+        const size_t K = static_cast<size_t>(hi - lo) + 1;
+        debug("Integer range: [%g, %g] (K=%zu, N=%zu, power=%d)\n",
+            lo, hi, K, N, simp_power);
+
+        // allocate dynamic programming data
+        dp_cost.resize(K);
+        dp_conv.resize(K);
+        dp_arg.resize(K);
+        dp_env.resize(K);
+        dp_bnd.resize(K + 1);
+        dp_from.resize(N * K);
+
+        if(!circular || N == 1){
+            // simple chain
+            objval = integer_chain(K, lo, K, true);
+
+        } else {
+            // cycle => condition on the first value
+            index_t best = 0;
+            double best_cost = std::numeric_limits<double>::infinity();
+            for(index_t v0 = 0; v0 < K; ++v0){
+                double cost = integer_chain(v0, lo, K, false);
+                if(cost < best_cost){
+                    best_cost = cost;
+                    best = v0;
+                }
+            }
+            objval = integer_chain(best, lo, K, true);
+        }
+        debug("Integer objective: %g\n", objval);
+
+        return static_cast<int>(nlopt::SUCCESS);
+    }
+
+    /**
+     * Align samples, derive short-row data and solve it
+     *
+     * The alignment warps samples by their Euclidean distance
+     * in a common frame. It is not the alignment of SRSolver,
+     * which links samples one to one with geodesic distances
+     * from the JS distance sampler, so the resulting cdata differ.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int solve_aligned(bool integer, bool verbose = false){
+        const size_t M = src_curv.size();
+        const size_t N = trg_curv.size();
+        if(M == 0 || N == 0)
+            return static_cast<int>(nlopt::INVALID_ARGS);
+
+        // alignment
+        {
+            StatsPhaseTimer timer(PHASE_PRECOMPUTE);
+            // allocate problem for the sources
+            allocate(M);
+            mapping.resize(M);
+            dtw_cost.resize(M * N);
+            dtw_src_use.resize(M * N);
+            dtw_trg_use.resize(M * N);
+            dtw_step.resize(M * N);
+
+            // compute alignment
+            if(!circular){
+                align_cost = dtw_align(0, true);
+
+            } else {
+                // circular => warp around the best linear target shift
+                align_cost = dtw_align_cyclic();
+            }
+            if(verbose)
+                printf("Alignment cost: %g (M=%zu, N=%zu)\n", align_cost, M, N);
+            if(align_cost == std::numeric_limits<double>::infinity())
+                return static_cast<int>(nlopt::FAILURE);
+            cdata_from_mapping();
+        }
+
+        // solve derived short-rows
+        return integer ? solve_integer(verbose) : solve(verbose);
+    }
+
+    // solve a batch of independent rows sequentially (reusing buffers)
+    // and return the number of rows that failed
+    EMSCRIPTEN_KEEPALIVE
+    size_t solve_batch(bool integer, bool verbose = false){
+        StatsPhaseTimer timer(PHASE_SOLVE, true); // rows are not separate calls
+        const size_t R = batch_circular.size();
+        size_t num_failed = 0;
+        // row parameters, restored after the batch
+        const bool   prev_circular = circular;
+        const int    prev_power    = simp_power;
+        const double prev_w_w      = w_w;
+        const double prev_w_s      = w_s;
+        for(index_t r = 0; r < R; ++r){
+            const index_t start = batch_offsets[r];
+            const index_t end   = batch_offsets[r + 1];
+            // set row problem
+            // /!\ allocate keeps the vector capacities across rows
+            allocate(end - start);
+            std::copy(
+                batch_cdata.begin() + start,
+                batch_cdata.begin() + end,
+                cdata.begin()
+            );
+            circular   = batch_circular[r];
+            simp_power = batch_power[r];
+            w_w = batch_weights[r * 2 + 0];
+            w_s = batch_weights[r * 2 + 1];
+
+            // solve row
+            int rc = static_cast<int>(nlopt::INVALID_ARGS);
+            if(end > start)
+                rc = integer ? solve_integer(verbose) : solve(verbose);
+            batch_rc[r] = rc;
+            batch_objval[r] = objval;
+            if(rc < 0){
+                ++num_failed;
+                std::fill(
+                    batch_output.begin() + start,
+                    batch_output.begin() + end,
+                    0.0
+                );
+            } else {
+                std::copy(nvars.begin(), nvars.end(), batch_output.begin() + start);
+            }
+        }
+        circular   = prev_circular;
+        simp_power = prev_power;
+        w_w = prev_w_w;
+        w_s = prev_w_s;
+        if(verbose)
+            printf("Batch of %zu rows, %zu failed\n", R, num_failed);
+        return num_failed;
+    }
+
+    // batch allocation (returns pointers for direct access)
+    EMSCRIPTEN_KEEPALIVE
+    void allocate_batch(size_t num_rows, size_t num_samples){
+        batch_cdata.resize(num_samples);
+        batch_offsets.resize(num_rows + 1);
+        batch_circular.resize(num_rows);
+        batch_power.resize(num_rows);
+        batch_weights.resize(num_rows * 2);
+        batch_output.resize(num_samples);
+        batch_objval.resize(num_rows);
+        batch_rc.resize(num_rows);
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_cdata_ptr(){
+        return reinterpret_cast<dptr_t>(batch_cdata.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_offsets_ptr(){
+        return reinterpret_cast<dptr_t>(batch_offsets.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_circular_ptr(){
+        return reinterpret_cast<dptr_t>(batch_circular.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_power_ptr(){
+        return reinterpret_cast<dptr_t>(batch_power.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_weights_ptr(){
+        return reinterpret_cast<dptr_t>(batch_weights.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_output_ptr(){
+        return reinterpret_cast<dptr_t>(batch_output.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_objval_ptr(){
+        return reinterpret_cast<dptr_t>(batch_objval.data());
+    }
+    EMSCRIPTEN_KEEPALIVE
+    dptr_t get_batch_rc_ptr(){
+        return reinterpret_cast<dptr_t>(batch_rc.data());
+    }
+
     // input setters
     EMSCRIPTEN_KEEPALIVE
+    void allocate_alignment(size_t num_sources, size_t num_targets){
+        src_xy.resize(num_sources * 2);
+        src_curv.resize(num_sources);
+        trg_xy.resize(num_targets * 2);
+        trg_curv.resize(num_targets);
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_source_sample(index_t index, double x, double y, double curv){
+        src_xy[index * 2 + 0] = x;
+        src_xy[index * 2 + 1] = y;
+        src_curv[index] = curv;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_target_sample(index_t index, double x, double y, double curv){
+        trg_xy[index * 2 + 0] = x;
+        trg_xy[index * 2 + 1] = y;
+        trg_curv[index] = curv;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_wale_distance(double d){
+        wale_dist = d;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_band_radius(size_t r){
+        band_radius = r;
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void set_max_reuse(size_t n){
+        max_reuse = std::min(size_t(255), n);
+    }
+    EMSCRIPTEN_KEEPALIVE
     void set_cdata(index_t index, double value){
         cdata[index] = value;
     }
@@ -329,11 +1129,10 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void set_simplicity_power(int power){
         switch(power){
+            case 0:
             case 1:
-                simp_L2 = false;
-                break;
             case 2:
-                simp_L2 = true;
+                simp_power = power;
                 break;
             default:
                 printf("Power not supported: %d\n", power);
@@ -418,6 +1217,18 @@ extern "C" {
         return objval;
     }
     EMSCRIPTEN_KEEPALIVE
+    double get_cdata_value(index_t index){
+        return cdata[index];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    index_t get_alignment(index_t index){
+        return mapping[index];
+    }
+    EMSCRIPTEN_KEEPALIVE
+    double get_alignment_cost(){
+        return align_cost;
+    }
+    EMSCRIPTEN_KEEPALIVE
     double check_gradient(bool print = true, double eps = 1e-4){
         bool pre_verbose = verbose;
         verbose = false; // disable so we can evaluate without info
@@ -12,12 +12,11 @@ class InvalidArgumentError extends Error {
 }
 
 const sr = Module;
-sr.nlopt_optimize = function nlopt_optimize(params){
+function setup_problem(params){
     // extract main data
     const cdata = params.cdata;
     const weights = params.weights || [1, 0.1];
     const circular = !!params.circular;
-    const verbose = !!params.verbose;
 
     // check main parameters{
     if(!cdata)
@@ -27,7 +26,8 @@ sr.nlopt_optimize = function nlopt_optimize(params){
 
     const numSamples = cdata.length;
 
-    // 1 = allocate problem
+    // 1 = allocate problem (growing the memory once)
+    sr._reserve(sr._plan_capacity(numSamples, 0));
     sr._allocate(numSamples);
 
     // 2 = set problem data
@@ -37,6 +37,12 @@ sr.nlopt_optimize = function nlopt_optimize(params){
     sr._set_circular(circular);
 
     // 3 = set potential parameters
+    set_parameters(params);
+
+    return numSamples;
+}
+
+function set_parameters(params){
     for(const pair of [
         ['seed', 'seed'],
         ['simplicityPower', 'simplicity_power'],
@@ -55,6 +61,14 @@ sr.nlopt_optimize = function nlopt_optimize(params){
             setter(value);
         }
     }
+}
+
+sr.nlopt_optimize = function nlopt_optimize(params){
+    const cdata = params.cdata;
+    const verbose = !!params.verbose;
+
+    // 1-3 = allocate and set problem data
+    setup_problem(params);
 
     // 4 = solve the problem
     const now = Date.now();
@@ -67,7 +81,173 @@ sr.nlopt_optimize = function nlopt_optimize(params){
     }
     
     // 5 = extract solution
-    return cdata.map((_, i) => {
+    return sr.time_readback(() => cdata.map((_, i) => {
         return sr._get_variable_value(i);
-    });
-};
\ No newline at end of file
+    }));
+};
+sr.integer_optimize = function integer_optimize(params){
+    const cdata = params.cdata;
+    const verbose = !!params.verbose;
+
+    // 1-3 = allocate and set problem data
+    setup_problem(params);
+
+    // 4 = solve the integer problem exactly
+    const now = Date.now();
+    const rc = sr._solve_integer(verbose);
+    if(rc < 0)
+        throw new InvalidArgumentError('Integer solver failed with code ' + rc);
+    if(verbose){
+        const duration = (Date.now() - now) / 1000.0;
+        console.log('Objective: ' + sr._get_objective_value());
+        console.log('Duration: ' + duration.toFixed(3) + 's');
+    }
+
+    // 5 = extract integer solution
+    return sr.time_readback(() => cdata.map((_, i) => {
+        return sr._get_variable_value(i);
+    }));
+};
+// align samples by Euclidean warping (in a common frame), then solve their short-rows
+// /!\ not a drop-in for SRSolver.alignSamples (one-to-one links, geodesic distances)
+sr.align_optimize = function align_optimize(params){
+    // extract main data
+    const sources = params.sources;
+    const targets = params.targets;
+    const srcCurv = params.sourceCurvatures;
+    const trgCurv = params.targetCurvatures;
+    const weights = params.weights || [1, 0.1];
+    const circular = !!params.circular;
+    const integer = 'integer' in params ? !!params.integer : true;
+    const verbose = !!params.verbose;
+
+    // check main parameters
+    if(!sources || !targets || !srcCurv || !trgCurv)
+        throw new InvalidArgumentError('Missing sources, targets or curvatures');
+    if(!sources.length || !targets.length)
+        throw new InvalidArgumentError('Sample data is empty');
+    if(sources.length !== srcCurv.length
+    || targets.length !== trgCurv.length)
+        throw new InvalidArgumentError('Curvature data is not coherent');
+    if(typeof params.waleDist !== 'number')
+        throw new InvalidArgumentError('Missing wale distance');
+
+    // 1 = allocate alignment problem
+    const M = sources.length;
+    const N = targets.length;
+    sr._reserve(sr._plan_alignment_capacity(M, N));
+    sr._allocate_alignment(M, N);
+
+    // 2 = set sample data
+    for(let i = 0; i < M; ++i){
+        const [x, y] = sources[i];
+        sr._set_source_sample(i, x, y, srcCurv[i]);
+    }
+    for(let j = 0; j < N; ++j){
+        const [x, y] = targets[j];
+        sr._set_target_sample(j, x, y, trgCurv[j]);
+    }
+    sr._set_wale_distance(params.waleDist);
+    sr._set_band_radius(params.bandRadius || 0);
+    sr._set_max_reuse(params.maxReuse || 0);
+    sr._set_weights(weights[0], weights[1]);
+    sr._set_circular(circular);
+
+    // 3 = set potential parameters
+    set_parameters(params);
+
+    // 4 = align and solve the problem
+    const now = Date.now();
+    const rc = sr._solve_aligned(integer, verbose);
+    if(rc < 0)
+        throw new InvalidArgumentError('Aligned solver failed with code ' + rc);
+    if(verbose){
+        const duration = (Date.now() - now) / 1000.0;
+        console.log('Return code: ' + rc);
+        console.log('Alignment cost: ' + sr._get_alignment_cost());
+        console.log('Objective: ' + sr._get_objective_value());
+        console.log('Duration: ' + duration.toFixed(3) + 's');
+    }
+
+    // 5 = extract solution
+    return sr.time_readback(() => ({
+        sr: sources.map((_, i) => sr._get_variable_value(i)),
+        cdata: sources.map((_, i) => sr._get_cdata_value(i)),
+        mapping: sources.map((_, i) => sr._get_alignment(i)),
+        alignCost: sr._get_alignment_cost()
+    }));
+};
+sr.batch_optimize = function batch_optimize(rows, params = {}){
+    const integer = 'integer' in params ? !!params.integer : true;
+    const verbose = !!params.verbose;
+
+    // check rows
+    if(!Array.isArray(rows))
+        throw new InvalidArgumentError('Rows must be an array');
+    const R = rows.length;
+    const offsets = new Int32Array(R + 1);
+    for(let r = 0; r < R; ++r){
+        const { cdata } = rows[r];
+        if(!cdata || !cdata.length)
+            throw new InvalidArgumentError('Row ' + r + ' has no cdata');
+        offsets[r + 1] = offsets[r] + cdata.length;
+    }
+    const numSamples = offsets[R];
+
+    // 1 = allocate batch
+    // /!\ views must be created after allocation (memory may grow)
+    sr._reserve(sr._plan_capacity(numSamples, R));
+    sr._allocate_batch(R, numSamples);
+    const cdataView = new Float64Array(
+        sr.HEAPF64.buffer, sr._get_batch_cdata_ptr(), numSamples);
+    const circView = new Uint8Array(
+        sr.HEAPU8.buffer, sr._get_batch_circular_ptr(), R);
+    const powView = new Uint8Array(
+        sr.HEAPU8.buffer, sr._get_batch_power_ptr(), R);
+    const weightView = new Float64Array(
+        sr.HEAPF64.buffer, sr._get_batch_weights_ptr(), R * 2);
+    new Int32Array(
+        sr.HEAP32.buffer, sr._get_batch_offsets_ptr(), R + 1
+    ).set(offsets);
+
+    // 2 = set packed row data
+    const defPower = 'simplicityPower' in params ? params.simplicityPower : 2;
+    const defWeights = params.weights || [1, 0.1];
+    for(let r = 0; r < R; ++r){
+        const {
+            cdata, circular,
+            weights = defWeights,
+            simplicityPower = defPower
+        } = rows[r];
+        cdataView.set(cdata, offsets[r]);
+        circView[r] = circular ? 1 : 0;
+        powView[r] = simplicityPower;
+        weightView[r * 2 + 0] = weights[0];
+        weightView[r * 2 + 1] = weights[1];
+    }
+
+    // 3 = set potential parameters
+    // note: the simplicity power is set per row
+    set_parameters(params);
+
+    // 4 = solve all rows
+    const now = Date.now();
+    const numFailed = sr._solve_batch(integer, verbose);
+    if(verbose){
+        const duration = (Date.now() - now) / 1000.0;
+        console.log('Batch rows: ' + R + ', failed: ' + numFailed);
+        console.log('Duration: ' + duration.toFixed(3) + 's');
+    }
+
+    // 5 = extract packed solution (copies, not views)
+    return sr.time_readback(() => ({
+        values: new Float64Array(
+            sr.HEAPF64.buffer, sr._get_batch_output_ptr(), numSamples).slice(),
+        objectives: new Float64Array(
+            sr.HEAPF64.buffer, sr._get_batch_objval_ptr(), R).slice(),
+        codes: new Int32Array(
+            sr.HEAP32.buffer, sr._get_batch_rc_ptr(), R).slice(),
+        offsets,
+        numFailed
+    }));
+};
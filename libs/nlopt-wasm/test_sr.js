@@ -64,4 +64,39 @@ sr_module().then(srm => {
     verbose: true
   });
   console.log('Solution:', sr);
+
+  // exact integer solutions for each simplicity power
+  for(const simplicityPower of [0, 1, 2]){
+    const isr = srm.integer_optimize({
+      cdata: cdata.map(v => v * 10), weights: [1, 1],
+      circular: true,
+      simplicityPower,
+      verbose: true
+    });
+    console.log('Integer solution (L' + simplicityPower + '):', isr);
+  }
+
+  // alignment where the reuse limit binds:
+  // sources clustered around the middle target would all reuse it
+  const M = 12, N = 5, maxReuse = 2;
+  const sources = Array.from({ length: M }, (_, i) => [2 + (i - M / 2) * 0.05, 0]);
+  const targets = Array.from({ length: N }, (_, j) => [j, 0]);
+  for(const reuse of [0, maxReuse]){
+    const { mapping, alignCost } = srm.align_optimize({
+      sources, targets,
+      sourceCurvatures: sources.map(() => 1),
+      targetCurvatures: targets.map(() => 1),
+      waleDist: 0.1, maxReuse: reuse
+    });
+    // longest run of sources matched to a same interior target
+    let run = 1, maxRun = 1;
+    for(let i = 1; i < M; ++i){
+      run = mapping[i] === mapping[i - 1] ? run + 1 : 1;
+      if(mapping[i] > 0 && mapping[i] + 1 < N)
+        maxRun = Math.max(maxRun, run);
+    }
+    console.log('Alignment (maxReuse=' + reuse + '):', mapping, 'cost', alignCost);
+    if(reuse && maxRun > reuse)
+      console.log('Error: target reused ' + maxRun + ' times');
+  }
 });
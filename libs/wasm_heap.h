@@ -0,0 +1,57 @@
+#ifndef WASM_HEAP_H
+#define WASM_HEAP_H
+
+#include <emscripten.h>
+#include <emscripten/heap.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * Heap reservation common to all the wasm modules.
+ *
+ * The modules are built with ALLOW_MEMORY_GROWTH and start small,
+ * so a large problem would grow the memory many times while allocating,
+ * each growth copying the heap and detaching the typed array views of JS.
+ * Instead, JS calls reserve(plan_capacity(...)) before allocating a problem,
+ * where plan_capacity is the estimate of each module given the problem size,
+ * and the memory grows at most once.
+ *
+ * Each module includes this header once.
+ */
+
+// allocator overhead per heap allocation (dlmalloc chunk header and alignment)
+#define HEAP_CHUNK_OVERHEAD 16
+
+// heap bytes of a vector of n elements
+template <typename T>
+inline size_t vector_bytes(size_t n){
+    return n ? n * sizeof(T) + HEAP_CHUNK_OVERHEAD : 0;
+}
+
+extern "C" {
+
+    // current memory size (in bytes)
+    EMSCRIPTEN_KEEPALIVE
+    size_t get_heap_size(){
+        return emscripten_get_heap_size();
+    }
+
+    /**
+     * Ensure that the given number of bytes can be allocated
+     * beyond the current heap break without growing the memory.
+     *
+     * Returns 1 if the memory is large enough (after growing it once), else 0.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int reserve(size_t bytes){
+        const size_t brk = uintptr_t(sbrk(0));
+        if(bytes > SIZE_MAX - brk)
+            return 0;
+        if(brk + bytes <= emscripten_get_heap_size())
+            return 1;
+        return emscripten_resize_heap(brk + bytes) ? 1 : 0;
+    }
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef WASM_STATS_H
+#define WASM_STATS_H
+
+#include <emscripten.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * Statistics common to all the wasm modules,
+ * written by get_stats(ptr) into a caller-owned buffer
+ * of get_stats_size() bytes (see wasm_stats.post.js).
+ *
+ * The binary layout is fixed:
+ *
+ *   uint32   version
+ *   uint32   module (see StatsModule)
+ *   float64  calls             top-level calls (solves, queries, plans)
+ *   float64  objective_evals
+ *   float64  constraint_evals
+ *   float64  phase_time[4]     ms in setup, precompute, solve, readback
+ *   float64  heap_high_water   bytes (highest heap break seen)
+ *   float64  cache_hits
+ *   float64  cache_misses
+ *   float64  cache_build_time  ms building cached data (on misses)
+ *
+ * Each module includes this header once and defines stats_module_id.
+ */
+#define WASM_STATS_VERSION 2
+
+enum StatsModule : uint32_t {
+    STATS_GLOBAL    = 0,
+    STATS_LOCAL     = 1,
+    STATS_SR        = 2,
+    STATS_GDIST     = 3,
+    STATS_XFER      = 4
+};
+
+enum StatsPhase : uint32_t {
+    PHASE_SETUP         = 0,
+    PHASE_PRECOMPUTE    = 1,
+    PHASE_SOLVE         = 2,
+    PHASE_READBACK      = 3,
+    NUM_PHASES          = 4
+};
+
+struct WasmStats {
+    uint32_t version;
+    uint32_t module;
+    double   calls;
+    double   objective_evals;
+    double   constraint_evals;
+    double   phase_time[NUM_PHASES];
+    double   heap_high_water;
+    double   cache_hits;
+    double   cache_misses;
+    double   cache_build_time;
+};
+static_assert(sizeof(WasmStats) == 8 + 11 * 8, "Stats layout changed");
+
+extern const uint32_t stats_module_id;
+static WasmStats module_stats = { WASM_STATS_VERSION };
+
+inline void stats_sample_heap(){
+    const double brk = double(uintptr_t(sbrk(0)));
+    if(brk > module_stats.heap_high_water)
+        module_stats.heap_high_water = brk;
+}
+
+inline void stats_cache(bool hit){
+    if(hit)
+        ++module_stats.cache_hits;
+    else
+        ++module_stats.cache_misses;
+}
+
+/**
+ * Scoped timer adding its lifetime to a phase
+ * and sampling the heap on exit.
+ * Phases do not overlap: timers nested in another one
+ * (e.g. recursive solves, or allocations within a batch solve) are ignored,
+ * and only the outer one counts as a call when requested.
+ */
+static bool stats_phase_active = false;
+
+struct StatsPhaseTimer {
+    StatsPhase phase;
+    bool       outer;
+    double     start = 0;
+
+    explicit StatsPhaseTimer(StatsPhase p, bool call = false)
+    : phase(p), outer(!stats_phase_active) {
+        if(!outer)
+            return;
+        stats_phase_active = true;
+        if(call)
+            ++module_stats.calls;
+        start = emscripten_get_now();
+    }
+    ~StatsPhaseTimer(){
+        if(!outer)
+            return;
+        stats_phase_active = false;
+        module_stats.phase_time[phase] += emscripten_get_now() - start;
+        stats_sample_heap();
+    }
+};
+
+extern "C" {
+
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_stats_size(){
+        return sizeof(WasmStats);
+    }
+
+    // write the statistics into the buffer, returns the bytes written
+    EMSCRIPTEN_KEEPALIVE
+    uint32_t get_stats(WasmStats *out){
+        if(!out)
+            return 0;
+        stats_sample_heap();
+        module_stats.version = WASM_STATS_VERSION;
+        module_stats.module = stats_module_id;
+        *out = module_stats;
+        return sizeof(WasmStats);
+    }
+
+    // stats buffer within the module heap, for JS callers
+    EMSCRIPTEN_KEEPALIVE
+    WasmStats *allocate_stats(){
+        return new WasmStats();
+    }
+    EMSCRIPTEN_KEEPALIVE
+    void free_stats(WasmStats *ptr){
+        delete ptr;
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    void reset_stats(){
+        module_stats = WasmStats();
+        module_stats.version = WASM_STATS_VERSION;
+        module_stats.module = stats_module_id;
+    }
+
+    // time spent outside of the module (e.g. readback loops in JS)
+    EMSCRIPTEN_KEEPALIVE
+    void add_stats_time(uint32_t phase, double ms){
+        if(phase < NUM_PHASES)
+            module_stats.phase_time[phase] += ms;
+    }
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+// common module statistics (see wasm_stats.h)
+const STATS_MODULES = ['global', 'local', 'sr', 'gdist', 'xfer'];
+const STATS_PHASES  = ['setup', 'precompute', 'solve', 'readback'];
+
+/**
+ * Statistics of the module since its start (or the last reset_stats)
+ *
+ * @return {
+ *    version, module, calls, objective_evals, constraint_evals,
+ *    time: { setup, precompute, solve, readback } (in ms),
+ *    heap_high_water (in bytes),
+ *    cache_hits, cache_misses, cache_hit_rate (NaN without lookup),
+ *    cache_build_time (in ms)
+ * }
+ */
+let statsBuffer = 0; // allocated once per module instance
+Module['get_stats'] = function get_stats(){
+    if(!statsBuffer)
+        statsBuffer = Module._allocate_stats();
+    const ptr = statsBuffer;
+    const size = Module._get_stats(ptr);
+    const header = new Uint32Array(Module.HEAPU8.buffer, ptr, 2);
+    const fields = new Float64Array(Module.HEAPU8.buffer, ptr + 8, (size - 8) / 8);
+    const time = {};
+    STATS_PHASES.forEach((phase, i) => {
+        time[phase] = fields[3 + i];
+    });
+    return {
+        version:            header[0],
+        module:             STATS_MODULES[header[1]],
+        calls:              fields[0],
+        objective_evals:    fields[1],
+        constraint_evals:   fields[2],
+        time,
+        heap_high_water:    fields[7],
+        cache_hits:         fields[8],
+        cache_misses:       fields[9],
+        cache_hit_rate:     fields[8] / (fields[8] + fields[9]),
+        cache_build_time:   fields[10]
+    };
+};
+
+Module['reset_stats'] = function reset_stats(){
+    Module._reset_stats();
+};
+
+/**
+ * Measure the readback of results from the module
+ *
+ * @param fn the readback function
+ * @return its result
+ */
+Module['time_readback'] = function time_readback(fn){
+    const start = performance.now();
+    const result = fn();
+    Module._add_stats_time(STATS_PHASES.indexOf('readback'), performance.now() - start);
+    return result;
+};
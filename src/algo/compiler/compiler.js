@@ -11,7 +11,7 @@ const { YarnStartPass, YarnEndPass } = require('./yarn.js');
 const AlignmentPass = require('./alignment.js');
 const ShapingPass = require('./shaping.js');
 const { HalfGaugeHook } = require('./halfgauge.js');
-const { xfer } = require('../../knitout/transfer.js');
+const Transfer = require('../../knitout/transfer.js');
 const SketchLayer = require('./sketchlayer.js');
 const Timer = require('../../timer.js');
 /** @typedef {import('../../knitout.js').sim.KnittingMachineState} KnittingMachineState */
@@ -289,9 +289,6 @@ CompilerAlgorithm.prototype.progress = function(){
 module.exports = Object.assign(CompilerAlgorithm, {
   // load
   resolve: function(){
-    if(xfer instanceof Promise)
-      return xfer;
-    else
-      return Promise.resolve(xfer);
+    return Transfer.resolve();
   }
 });
\ No newline at end of file
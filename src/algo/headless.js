@@ -0,0 +1,515 @@
+// Alexandre Kaspar <akaspar@mit.edu>
+"use strict";
+
+// Usage: node src/algo/headless.js [sketch directory or files] [options]
+//
+// Runs the full pipeline (meshing, flow+time, sampling, tracing,
+// scheduling and compiling) without the browser, and writes a JSON report
+// with the wall time of each stage, the number of wasm calls,
+// and the wasm heap and binary sizes of each native module.
+//
+// Options:
+//    --report file.json    the report file (defaults to stdout)
+//    --out directory       where to write the knitout outputs
+//    --filter regexp       only run the sketches whose path matches
+//    --label name          label of the run in the report (e.g. build flags)
+//    --verbose             log the pipeline progress
+//
+// This requires the canvas package (for rasterizing the sketches).
+
+// modules
+const fs = require('fs');
+const path = require('path');
+const { performance } = require('perf_hooks');
+const wasm = require('../wasm.js');
+const { nodeOptions } = require('./jobqueue-node.js');
+
+// settings identifiers (from the html pages) of the init actions in sketches/list.json
+// e.g. "set:mesh_levels:2" sets env.global.meshLevels
+function settingsMap(){
+  const htmlDir = path.join(__dirname, '..', '..', 'html');
+  const map = {};
+  for(const name of fs.readdirSync(htmlDir)){
+    if(!name.endsWith('.html'))
+      continue;
+    const html = fs.readFileSync(path.join(htmlDir, name), 'utf8');
+    for(const [tag] of html.matchAll(/<(?:input|select)\b[^>]*>/g)){
+      const id = (tag.match(/\bid="([^"]+)"/) || [])[1];
+      const key = (tag.match(/\bdata-env="([^"]+)"/) || [])[1];
+      if(id && key)
+        map[id] = key;
+    }
+  }
+  return map;
+}
+
+/**
+ * Apply the init actions of a sketch entry to the parameters.
+ * Only the actions on parameters are supported (set, env, sketch-scale),
+ * the UI ones (click, sketch-mode ...) are returned as ignored.
+ *
+ * @param params the global parameters (modified)
+ * @param actions the comma-separated list of actions
+ * @param settings the settings identifier map
+ * @return the list of ignored actions
+ */
+function applyActions(params, actions, settings){
+  const ignored = [];
+  for(const action of actions.split(',').filter(str => str.length)){
+    let [what, ...args] = action.split(':');
+    let container = params;
+    let key;
+    let value = args[args.length - 1];
+    if(what === 'set' && args[0] in settings){
+      key = settings[args[0]];
+    } else if(what === 'sketch-scale' || what === 'env'){
+      if(what === 'sketch-scale')
+        args = ['sizing', 'sketch', 'scale', ...args];
+      for(let i = 0; i < args.length - 2; ++i)
+        container = container[args[i]];
+      key = args[args.length - 2];
+    } else {
+      ignored.push(action);
+      continue;
+    }
+    switch(typeof container[key]){
+      case 'number':
+        value = parseFloat(value);
+        break;
+      case 'boolean':
+        value = !!value.match(/true|on|1/i);
+        break;
+    }
+    container[key] = value;
+  }
+  return ignored;
+}
+
+/**
+ * List the sketch files to process, with their init actions
+ * from the closest sketch list (e.g. sketches/list.json)
+ *
+ * @param targets the list of directories or files
+ * @return [{ file, actions }]
+ */
+function listSketches(targets){
+  const files = [];
+  const visit = file => {
+    if(fs.statSync(file).isDirectory()){
+      for(const name of fs.readdirSync(file).sort())
+        visit(path.join(file, name));
+    } else if(file.endsWith('.json') && path.basename(file) !== 'list.json')
+      files.push(path.resolve(file));
+  };
+  for(const target of targets)
+    visit(target);
+  // find actions from sketch lists
+  const lists = new Map(); // directory => (file => actions)
+  const actionsOf = file => {
+    for(let dir = path.dirname(file); ; dir = path.dirname(dir)){
+      if(!lists.has(dir)){
+        const entries = new Map();
+        const listFile = path.join(dir, 'list.json');
+        if(fs.existsSync(listFile)){
+          for(const entry of JSON.parse(fs.readFileSync(listFile, 'utf8'))){
+            if(typeof entry === 'string')
+              continue; // section name
+            let params = entry.params || '';
+            if(Array.isArray(params))
+              params = params.join(',');
+            entries.set(path.resolve(dir, entry.path), params);
+          }
+        }
+        lists.set(dir, entries);
+      }
+      const entries = lists.get(dir);
+      if(entries.has(file))
+        return entries.get(file);
+      if(path.dirname(dir) === dir)
+        return '';
+    }
+  };
+  return files.map(file => ({ file, actions: actionsOf(file) }));
+}
+
+// statistics exports, which are not counted (see wasmStats)
+const STATS_EXPORTS = new Set([
+  '_get_stats_size', '_get_stats', '_allocate_stats', '_free_stats'
+]);
+
+/**
+ * Wrap the exported functions of a wasm module to count their calls.
+ *
+ * /!\ emscripten can replace its export wrappers upon their first call,
+ * so the exports are redefined with accessors that keep the counting wrapper
+ */
+function instrument(m){
+  const calls = {};
+  for(const key of Object.keys(m)){
+    if(!/^_[a-z]/.test(key) || typeof m[key] !== 'function'
+    || STATS_EXPORTS.has(key))
+      continue;
+    let fn = m[key];
+    calls[key] = 0;
+    const counted = function(){
+      ++calls[key];
+      return fn.apply(this, arguments);
+    };
+    Object.defineProperty(m, key, {
+      get: () => counted,
+      set: f => { fn = f; },
+      enumerable: true
+    });
+  }
+  return calls;
+}
+
+class PipelineProfiler {
+  constructor(){
+    this.modules = {}; // name => { module, calls }
+    wasm.onLoad((name, m) => {
+      this.modules[name] = { module: m, calls: instrument(m) };
+    });
+  }
+
+  // total call counts of each module export
+  snapshot(){
+    const snap = {};
+    for(const [name, { calls }] of Object.entries(this.modules))
+      snap[name] = Object.assign({}, calls);
+    return snap;
+  }
+
+  /**
+   * Wasm statistics since a snapshot.
+   * The heap bytes are the peak heap use so far (heap_high_water of get_stats),
+   * or the memory size for modules without it, which only bounds the peak.
+   */
+  wasmStats(snap){
+    const stats = {};
+    for(const [name, { module, calls }] of Object.entries(this.modules)){
+      const exports = {};
+      let total = 0;
+      for(const key in calls){
+        const count = calls[key] - ((snap[name] || {})[key] || 0);
+        if(!count)
+          continue;
+        exports[key.substring(1)] = count;
+        total += count;
+      }
+      let heapBytes = module.HEAPU8 ? module.HEAPU8.length : 0;
+      if(typeof module._get_stats === 'function')
+        heapBytes = module.get_stats().heap_high_water;
+      stats[name] = { calls: total, exports, heapBytes };
+    }
+    return stats;
+  }
+
+  /**
+   * Run an iterative stage, repeating each step until all algorithms are done
+   * (as the iterative workers do)
+   *
+   * @param name the stage name
+   * @param algorithms the list of algorithms
+   * @param steps the list of [name, algorithm => done]
+   * @return the stage report
+   */
+  stage(name, algorithms, steps){
+    const snap = this.snapshot();
+    const start = performance.now();
+    const stepReports = steps.map(([stepName, stepFun]) => {
+      const stepStart = performance.now();
+      let iterations = 0;
+      let done;
+      do {
+        done = algorithms.map(algo => {
+          const res = stepFun(algo);
+          return res || res === undefined; // undefined => always done
+        }).every(d => d);
+        ++iterations;
+      } while(!done);
+      return {
+        name: stepName, iterations,
+        time: performance.now() - stepStart
+      };
+    });
+    return {
+      name,
+      time: performance.now() - start,
+      steps: stepReports,
+      wasm: this.wasmStats(snap)
+    };
+  }
+}
+
+/**
+ * Load the root sketches of a sketch file
+ * (background images are not loaded since they do not impact the pipeline)
+ */
+function loadSketches(data){
+  const SketchObject = require('../sketch/object.js');
+  const Sketch = require('../sketch/sketch.js');
+  const Curve = require('../sketch/curve.js');
+  const PCurve = require('../sketch/pcurve.js');
+  const Link = require('../sketch/link.js');
+  SketchObject.resetUUID();
+  Link.clear();
+  const map = {};
+  const sketches = data.sketches.map(skData => {
+    const sketch = new Sketch();
+    sketch.deserialize(skData, map, true);
+    return sketch;
+  });
+  for(const cData of data.curves)
+    new Curve().deserialize(cData, map, true);
+  for(const pData of data.pcurves || [])
+    new PCurve().deserialize(pData, map, true);
+  for(const skobj of Object.values(map)){
+    if(skobj.isRoot())
+      skobj.remap(id => map[id]);
+  }
+  return sketches;
+}
+
+/**
+ * Run the pipeline over a sketch file
+ *
+ * @param profiler the pipeline profiler
+ * @param file the sketch file
+ * @param actions the init actions
+ * @param options { outDir, verbose, settings }
+ * @return the sketch report
+ */
+function runSketch(profiler, file, actions, { outDir, verbose, settings }){
+  const env = require('../env.js');
+  const defaultGlobal = require('../defaults.js');
+  const Sizing = require('../sizing.js');
+  const Mesh = require('./mesh/mesh.js');
+  const TimeSolverAlgorithm = require('./mesh/solver.js');
+  const Action = require('./compiler/action.js');
+  const SamplingAlgorithm = require('./stitch/sampling.js');
+  const TracingAlgorithm = require('./trace/tracing.js');
+  const SchedulingAlgorithm = require('./schedule/scheduling.js');
+  const CompilerAlgorithm = require('./compiler/compiler.js');
+
+  const data = JSON.parse(fs.readFileSync(file, 'utf8'));
+  const envData = 'sketch' in data ? data : { sketch: data };
+
+  // parameters (as from the UI)
+  const params = defaultGlobal();
+  if(params.loadGlobals && envData.global)
+    Object.assign(params, envData.global);
+  else if(envData.global && envData.global.stitchProgram
+       && envData.global.stitchProgram.length)
+    params.stitchProgram = envData.global.stitchProgram;
+  const ignored = applyActions(params, actions, settings);
+  params.verbose = verbose;
+  env.global = params;
+  Action.resetPrograms();
+
+  const report = { ignored, stages: [] };
+  const start = performance.now();
+  const run = (name, algorithms, steps) => {
+    if(verbose)
+      console.error('  ' + name);
+    const stage = profiler.stage(name, algorithms, steps);
+    report.stages.push(stage);
+    return stage;
+  };
+
+  // meshing (rasterization and geodesic distances)
+  let meshes, sketches;
+  run('mesh', [null], [
+    ['load', () => { sketches = loadSketches(envData.sketch); }],
+    ['mesh', () => { meshes = Mesh.fromSketches(sketches, params); }]
+  ]);
+  report.meshes = meshes.length;
+
+  // flow+time solver
+  const solvers = meshes.map(mesh => new TimeSolverAlgorithm(mesh, params));
+  run('flow', solvers, [
+    ['iterate', s => s.iterate()]
+  ]);
+
+  // sampling parameters (as from the schedule update)
+  const sizeInfo = params.sizing;
+  const mmPerPx = Sizing.parseAsRatio(sizeInfo.sketch.scale, 'mm', 'px');
+  const walePerMM = Sizing.parseAsRatio(sizeInfo['default'].wale, 'stitches', 'mm');
+  const wppx = walePerMM.asScalar() * mmPerPx.asScalar();
+  const coursePerMM = Sizing.parseAsRatio(sizeInfo['default'].course, 'stitches', 'mm');
+  const cppx = coursePerMM.asScalar() * mmPerPx.asScalar();
+  const schedParams = Object.assign({
+    courseDist: 1 / cppx,
+    waleDist: 1 / wppx,
+    sketchScale: mmPerPx.asScalar()
+  }, params);
+  for(const mesh of meshes)
+    mesh.computeSeamLayers(params);
+
+  const samplers = meshes.map(mesh => new SamplingAlgorithm(mesh, schedParams));
+  run('sampling', samplers, [
+    [ 'init',         s => s.init() ],
+    [ 'globalSample', s => s.globalSample() ],
+    [ 'localSample',  s => s.localSample() ],
+    [ 'instantiate',  s => s.instantiate() ],
+    [ 'distribute',   s => s.distribute() ],
+    [ 'subdivide',    s => s.subdivide() ],
+    [ 'split',        s => s.split() ],
+    [ 'finish',       s => s.finish() ]
+  ]);
+  const tracers = samplers.map(s => new TracingAlgorithm(s.sampler, schedParams));
+  run('tracing', tracers, [
+    [ 'init',       t => t.init() ],
+    [ 'traceYarn',  t => t.traceYarn() ],
+    [ 'finish',     t => t.finish() ]
+  ]);
+  const schedulers = tracers.map(t => new SchedulingAlgorithm(t.trace, schedParams));
+  run('scheduling', schedulers, [
+    [ 'init',                  s => s.init() ],
+    [ 'optimizeBetweenNodes',  s => s.optimizeBetweenNodes() ],
+    [ 'optimizeWithinNodes',   s => s.optimizeWithinNodes() ],
+    [ 'generateBlocks',        s => s.generateBlocks() ],
+    [ 'optimizeBlocksOffsets', s => s.optimizeBlocksOffsets() ],
+    [ 'finish',                s => s.finish() ]
+  ]);
+  const compilers = schedulers.map(s => new CompilerAlgorithm(s.nodes, schedParams));
+  run('compiling', compilers, [
+    [ 'init',     c => c.init() ],
+    [ 'assemble', c => c.assemble() ],
+    [ 'generate', c => c.generate() ],
+    [ 'modify',   c => c.modify() ],
+    [ 'finish',   c => c.finish() ]
+  ]);
+  report.time = performance.now() - start;
+
+  // knitout outputs
+  const outputs = compilers.map(c => c.program.output.toString());
+  report.knitoutLines = outputs.map(str => str.split('\n').length);
+  if(outDir){
+    const base = path.basename(file, '.json');
+    outputs.forEach((str, i) => {
+      const suffix = outputs.length > 1 ? '-' + i : '';
+      fs.writeFileSync(path.join(outDir, base + suffix + '.k'), str);
+    });
+  }
+  return report;
+}
+
+// sum the stage times and wasm calls over all sketches
+function summarize(sketchReports){
+  const stages = {};
+  for(const { stages: list = [] } of sketchReports){
+    for(const { name, time, wasm: wstats } of list){
+      const summary = stages[name] || (stages[name] = { time: 0, wasmCalls: {} });
+      summary.time += time;
+      for(const [mod, { calls }] of Object.entries(wstats))
+        summary.wasmCalls[mod] = (summary.wasmCalls[mod] || 0) + calls;
+    }
+  }
+  return stages;
+}
+
+// size of the wasm binaries (in bytes)
+function wasmBinarySizes(){
+  const libDir = path.join(__dirname, '..', '..', 'libs');
+  const sizes = {};
+  for(const dir of fs.readdirSync(libDir)){
+    const dirPath = path.join(libDir, dir);
+    if(!fs.statSync(dirPath).isDirectory())
+      continue;
+    for(const file of fs.readdirSync(dirPath)){
+      if(file.endsWith('.wasm'))
+        sizes[file] = fs.statSync(path.join(dirPath, file)).size;
+    }
+  }
+  return sizes;
+}
+
+function main(argv){
+  const targets = [];
+  const options = { verbose: false };
+  for(let i = 0; i < argv.length; ++i){
+    switch(argv[i]){
+      case '--report':  options.reportFile = argv[++i]; break;
+      case '--out':     options.outDir = argv[++i]; break;
+      case '--filter':  options.filter = new RegExp(argv[++i]); break;
+      case '--label':   options.label = argv[++i]; break;
+      case '--verbose': options.verbose = true; break;
+      default:
+        targets.push(argv[i]);
+    }
+  }
+  if(!targets.length)
+    targets.push(path.join(__dirname, '..', '..', 'sketches'));
+  if(options.outDir && !fs.existsSync(options.outDir))
+    fs.mkdirSync(options.outDir, { recursive: true });
+
+  // node environment, before loading the pipeline modules
+  const { createCanvas, Image } = require('canvas');
+  require('./mesh/layer.js').setCanvasFactory(createCanvas);
+  if(typeof global.Image === 'undefined')
+    global.Image = Image;
+  wasm.setModuleOptions(nodeOptions);
+  const profiler = new PipelineProfiler();
+  require('./stitch/sampling.js');
+  require('./compiler/compiler.js');
+  require('./mesh/distance.js');
+
+  const settings = settingsMap();
+  let entries = listSketches(targets);
+  if(options.filter)
+    entries = entries.filter(({ file }) => options.filter.test(file));
+
+  const loadStart = performance.now();
+  return wasm.ready().then(() => {
+    const report = {
+      label: options.label,
+      date: new Date().toISOString(),
+      node: process.version,
+      wasmLoadTime: performance.now() - loadStart,
+      wasmSizes: wasmBinarySizes(),
+      sketches: []
+    };
+    for(const { file, actions } of entries){
+      const name = path.relative(process.cwd(), file);
+      if(options.verbose)
+        console.error(name);
+      let sketchReport;
+      try {
+        sketchReport = runSketch(profiler, file, actions, Object.assign({
+          settings
+        }, options));
+      } catch(err){
+        sketchReport = { error: err.message || String(err) };
+        if(options.verbose)
+          console.error(err);
+      }
+      report.sketches.push(Object.assign({ path: name, actions }, sketchReport));
+    }
+    report.stages = summarize(report.sketches);
+    report.wasm = profiler.wasmStats({});
+    const json = JSON.stringify(report, null, 2);
+    if(options.reportFile)
+      fs.writeFileSync(options.reportFile, json);
+    else
+      console.log(json);
+    return report.sketches.every(s => !s.error);
+  });
+}
+
+if(require.main === module){
+  main(process.argv.slice(2)).then(success => {
+    process.exit(success ? 0 : 1);
+  }).catch(err => {
+    console.error(err);
+    process.exit(1);
+  });
+}
+
+module.exports = {
+  main,
+  runSketch,
+  listSketches,
+  applyActions,
+  PipelineProfiler
+};
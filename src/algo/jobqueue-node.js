@@ -0,0 +1,76 @@
+// Alexandre Kaspar <akaspar@mit.edu>
+"use strict";
+
+// modules
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { Worker, isMainThread, parentPort } = require('worker_threads');
+const JobQueue = require('./jobqueue.js');
+const { MODULES } = require('./jobring.js');
+
+/**
+ * Message-event adapter, so that worker_threads ports
+ * look like web workers (addEventListener with event.data)
+ */
+function adapt(port){
+  const listeners = new Map();
+  return {
+    postMessage: (data, buffers) => port.postMessage(data, buffers),
+    addEventListener(type, fn){
+      const wrapper = data => fn({ data });
+      listeners.set(fn, wrapper);
+      port.on(type, wrapper);
+    },
+    removeEventListener(type, fn){
+      port.off(type, listeners.get(fn));
+      listeners.delete(fn);
+    },
+    terminate: () => port.terminate()
+  };
+}
+
+/**
+ * Create a job queue over Node worker threads
+ *
+ * @param size the number of workers (defaults to the number of cores)
+ * @param modules the modules to host in each worker
+ * @param options { shared, capacity, arenaBytes }
+ */
+function createNodeQueue(size = os.cpus().length, modules = MODULES, options = {}){
+  const workers = Array.from({ length: size }, () => {
+    return adapt(new Worker(__filename));
+  });
+  return new JobQueue(workers, modules, options);
+}
+
+// emscripten options with the wasm binary read from disk
+// (the fetch-based loading only works with URLs)
+function nodeOptions(name, directory){
+  const dir = path.join(__dirname, '..', '..', directory);
+  return {
+    locateFile: file => path.join(dir, file),
+    instantiateWasm(imports, receive){
+      const file = fs.readdirSync(dir).find(f => {
+        return f.endsWith('.wasm') && f.startsWith(wasmNames[name]);
+      });
+      WebAssembly.instantiate(fs.readFileSync(path.join(dir, file)), imports)
+        .then(({ instance, module }) => receive(instance, module));
+      return {};
+    }
+  };
+}
+const wasmNames = {
+  global: 'global_sampling', local: 'local_sampling', sr: 'sr_sampling',
+  gdist: 'gdist', xfer: 'plan_transfers'
+};
+
+// worker thread entry
+if(!isMainThread && parentPort){
+  require('./jobworker.js')(adapt(parentPort), nodeOptions);
+}
+
+module.exports = {
+  createNodeQueue,
+  nodeOptions
+};
@@ -0,0 +1,159 @@
+// Alexandre Kaspar <akaspar@mit.edu>
+"use strict";
+
+// modules
+const assert = require('../assert.js');
+const {
+  JobRing, ArenaAllocator, MODULES, DECODED,
+  hasSharedMemory, encodePayload
+} = require('./jobring.js');
+
+/**
+ * Pool of workers hosting the solver modules,
+ * which process jobs concurrently.
+ *
+ * With shared memory, the jobs are published in a shared request ring
+ * from which idle workers claim them. Without it (e.g. when the page is
+ * not cross-origin isolated), jobs are posted to the least busy worker.
+ * Results come back by message with their buffers transferred.
+ *
+ * Usage:
+ *    const queue = JobQueue.create(4, ['xfer', 'gdist']);
+ *    queue.submit('xfer', 'plan_transfers', [from, to, params]).then(...)
+ */
+class JobQueue {
+  constructor(workers, modules = MODULES, {
+    shared = hasSharedMemory(),
+    capacity = 64,
+    arenaBytes = 1 << 24
+  } = {}){
+    assert(workers.length > 0, 'Job queue needs at least one worker');
+    this.workers = workers;
+    this.modules = modules;
+    this.ring = shared ? JobRing.create(capacity, arenaBytes) : null;
+    this.arena = shared ? new ArenaAllocator(arenaBytes) : null;
+    // job state
+    this.nextId = 0;
+    this.nextSeq = 0; // next ring sequence number
+    this.tailSeq = 0; // oldest ring sequence number not reclaimed
+    this.backlog = []; // jobs waiting for ring space
+    this.pending = new Map(); // jobId => { resolve, reject, worker }
+    this.load = workers.map(() => 0);
+    // worker initialization
+    this.ready = Promise.all(workers.map((worker, i) => new Promise((resolve, reject) => {
+      const onReady = event => {
+        if(!('ready' in event.data))
+          return;
+        worker.removeEventListener('message', onReady);
+        if(event.data.ready)
+          resolve();
+        else
+          reject(new Error(event.data.error));
+      };
+      worker.addEventListener('message', onReady);
+      worker.addEventListener('message', event => this.receive(i, event.data));
+      worker.postMessage({
+        modules, ring: this.ring ? this.ring.toData() : null
+      });
+    })));
+  }
+
+  /**
+   * Submit a job calling a module method in a worker
+   *
+   * @param moduleName the module ('global', 'local', 'sr', 'gdist' or 'xfer')
+   * @param method the method name (or a composite job, e.g. gdist.distancesFrom)
+   * @param args the method arguments (structured-cloneable)
+   * @return a promise of the result
+   */
+  submit(moduleName, method, args = []){
+    const moduleIndex = MODULES.indexOf(moduleName);
+    assert(moduleIndex !== -1 && this.modules.includes(moduleName),
+      'Module not hosted by the job queue', moduleName);
+    const jobId = this.nextId++;
+    return new Promise((resolve, reject) => {
+      this.pending.set(jobId, { resolve, reject, worker: -1 });
+      const job = { jobId, module: moduleIndex, payload: { method, args } };
+      if(this.ring){
+        this.backlog.push(job);
+        this.flush();
+      } else {
+        // post to least busy worker
+        const w = this.load.indexOf(Math.min(...this.load));
+        this.pending.get(jobId).worker = w;
+        ++this.load[w];
+        this.workers[w].postMessage({ job });
+      }
+    });
+  }
+
+  // reclaim decoded ring slots and publish the backlog
+  flush(){
+    while(this.tailSeq < this.nextSeq
+       && this.ring.stateOf(this.tailSeq) === DECODED){
+      this.ring.release(this.tailSeq++);
+      this.arena.free();
+    }
+    while(this.backlog.length
+       && this.nextSeq - this.tailSeq < this.ring.capacity){
+      const { jobId, module: moduleIndex, payload } = this.backlog[0];
+      const bytes = encodePayload(payload);
+      assert(bytes.length <= this.arena.size,
+        'Job payload is larger than the shared arena', bytes.length);
+      const offset = this.arena.allocate(bytes.length);
+      if(offset < 0)
+        break; // wait for space
+      this.ring.arena.set(bytes, offset);
+      this.ring.publish(this.nextSeq++, jobId, moduleIndex, offset, bytes.length);
+      this.backlog.shift();
+    }
+  }
+
+  receive(w, data){
+    if(!('jobId' in data))
+      return;
+    const job = this.pending.get(data.jobId);
+    if(!job)
+      return;
+    this.pending.delete(data.jobId);
+    if(job.worker >= 0)
+      --this.load[job.worker];
+    if(data.error)
+      job.reject(new Error(data.error));
+    else
+      job.resolve(data.result);
+    if(this.ring)
+      this.flush();
+  }
+
+  close(){
+    if(this.ring)
+      this.ring.shutdown();
+    for(const job of this.pending.values())
+      job.reject(new Error('Job queue closed'));
+    this.pending.clear();
+    this.backlog = [];
+    for(const worker of this.workers)
+      worker.terminate();
+  }
+
+  /**
+   * Create a job queue over web workers
+   *
+   * @param size the number of workers (defaults to the number of cores)
+   * @param modules the modules to host in each worker
+   * @param options { shared, capacity, arenaBytes }
+   */
+  static create(
+    size = typeof navigator !== 'undefined' ? navigator.hardwareConcurrency || 4 : 4,
+    modules = MODULES, options = {}
+  ){
+    const workify = require('webworkify');
+    const workers = Array.from({ length: size }, () => {
+      return workify(require('./jobworker.js'));
+    });
+    return new JobQueue(workers, modules, options);
+  }
+}
+
+module.exports = JobQueue;
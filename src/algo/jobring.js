@@ -0,0 +1,294 @@
+// Alexandre Kaspar <akaspar@mit.edu>
+"use strict";
+
+/**
+ * Shared-memory request ring for solver jobs.
+ *
+ * The control block is an Int32Array over a SharedArrayBuffer with
+ *   - a header (HEAD, CLAIM, SHUTDOWN),
+ *   - a ring of job slots (STATE, JOB_ID, MODULE, OFFSET, LENGTH).
+ *
+ * The job payloads are encoded in a separate shared byte arena
+ * allocated in FIFO order by the main thread.
+ *
+ * The main thread is the only producer (it increments HEAD),
+ * while workers claim jobs by incrementing CLAIM atomically.
+ */
+
+// header indices
+const HEAD      = 0; // number of submitted jobs
+const CLAIM     = 1; // number of claimed jobs
+const SHUTDOWN  = 2; // non-zero to stop workers
+const HEADER_SIZE = 4;
+
+// slot fields
+const STATE   = 0;
+const JOB_ID  = 1;
+const MODULE  = 2;
+const OFFSET  = 3;
+const LENGTH  = 4;
+const SLOT_SIZE = 5;
+
+// slot states
+const EMPTY   = 0;
+const READY   = 1; // payload written
+const DECODED = 2; // payload copied by a worker (arena can be freed)
+
+// solver modules that jobs can target
+const MODULES = ['global', 'local', 'sr', 'gdist', 'xfer'];
+
+// typed array constructors that can be encoded
+const TYPED_ARRAYS = {
+  Int8Array, Uint8Array, Int16Array, Uint16Array,
+  Int32Array, Uint32Array, Float32Array, Float64Array
+};
+
+function hasSharedMemory(){
+  return typeof SharedArrayBuffer !== 'undefined'
+      && typeof Atomics !== 'undefined'
+      && (typeof crossOriginIsolated === 'undefined' || crossOriginIsolated);
+}
+
+/**
+ * Encode a job payload into a byte array, where typed arrays
+ * are moved into an aligned binary section after the JSON header
+ *
+ *   [u32 json length][json][padding][binary blocks]
+ *
+ * Non-finite numbers (e.g. Infinity weights) and undefined array entries
+ * are tagged since JSON would turn them into null.
+ * Undefined object properties are dropped as with JSON.
+ *
+ * @param payload the job payload
+ * @return Uint8Array
+ */
+function encodePayload(payload){
+  const blocks = [];
+  let binSize = 0;
+  const json = JSON.stringify(payload, function(key, value){
+    if(ArrayBuffer.isView(value) && value.constructor.name in TYPED_ARRAYS){
+      const offset = binSize;
+      blocks.push([offset, value]);
+      binSize += Math.ceil(value.byteLength / 8) * 8;
+      return { $t: value.constructor.name, o: offset, n: value.length };
+    }
+    if(typeof value === 'number' && !Number.isFinite(value))
+      return { $n: String(value) }; // Infinity, -Infinity or NaN
+    if(value === undefined && Array.isArray(this))
+      return { $u: 1 };
+    return value;
+  });
+  const text = new TextEncoder().encode(json);
+  const binStart = Math.ceil((4 + text.length) / 8) * 8;
+  const bytes = new Uint8Array(binStart + binSize);
+  new DataView(bytes.buffer).setUint32(0, text.length, true);
+  bytes.set(text, 4);
+  for(const [offset, value] of blocks){
+    bytes.set(
+      new Uint8Array(value.buffer, value.byteOffset, value.byteLength),
+      binStart + offset
+    );
+  }
+  return bytes;
+}
+
+/**
+ * Decode a job payload from shared memory
+ * (the typed arrays are copied, so the memory can be reused)
+ *
+ * @param arena the shared byte arena
+ * @param offset the payload offset
+ * @param length the payload byte length
+ * @return the job payload
+ */
+function decodePayload(arena, offset, length){
+  const bytes = arena.slice(offset, offset + length);
+  const textLength = new DataView(bytes.buffer).getUint32(0, true);
+  const json = new TextDecoder().decode(bytes.subarray(4, 4 + textLength));
+  const binStart = Math.ceil((4 + textLength) / 8) * 8;
+  return JSON.parse(json, (key, value) => {
+    if(value && typeof value === 'object'){
+      if('$t' in value){
+        const TypedArray = TYPED_ARRAYS[value.$t];
+        return new TypedArray(bytes.buffer, binStart + value.o, value.n);
+      }
+      if('$n' in value)
+        return Number(value.$n);
+      if('$u' in value)
+        return undefined; // leaves an empty array entry
+    }
+    return value;
+  });
+}
+
+/**
+ * Transferable buffers of a job result
+ * (typed arrays over a given memory are copied first)
+ *
+ * @param result the job result (modified in place)
+ * @param memories buffers that must not be transferred (e.g. wasm heaps)
+ * @return the list of buffers to transfer
+ */
+function transferablesOf(result, memories = []){
+  const buffers = new Set();
+  const visit = (value, parent, key) => {
+    if(!value || typeof value !== 'object')
+      return;
+    if(ArrayBuffer.isView(value)){
+      if(memories.includes(value.buffer)){
+        value = value.slice();
+        parent[key] = value;
+      }
+      if(!(value.buffer instanceof ArrayBuffer))
+        return; // shared memory cannot be transferred
+      if(value.byteOffset === 0 && value.byteLength === value.buffer.byteLength)
+        buffers.add(value.buffer);
+      return;
+    }
+    for(const k of Object.keys(value))
+      visit(value[k], value, k);
+  };
+  const root = { result };
+  visit(result, root, 'result');
+  return { result: root.result, buffers: Array.from(buffers) };
+}
+
+class JobRing {
+  constructor(control, arena){
+    this.control = control; // Int32Array
+    this.arena = arena;     // Uint8Array
+    this.capacity = (control.length - HEADER_SIZE) / SLOT_SIZE;
+  }
+
+  static create(capacity = 64, arenaBytes = 1 << 24){
+    const control = new Int32Array(new SharedArrayBuffer(
+      (HEADER_SIZE + capacity * SLOT_SIZE) * 4
+    ));
+    const arena = new Uint8Array(new SharedArrayBuffer(arenaBytes));
+    return new JobRing(control, arena);
+  }
+  static fromData({ control, arena }){
+    return new JobRing(new Int32Array(control), new Uint8Array(arena));
+  }
+  toData(){
+    return { control: this.control.buffer, arena: this.arena.buffer };
+  }
+
+  slot(seq){
+    return HEADER_SIZE + (seq % this.capacity) * SLOT_SIZE;
+  }
+  head(){ return Atomics.load(this.control, HEAD); }
+  claimed(){ return Atomics.load(this.control, CLAIM); }
+  isShutdown(){ return Atomics.load(this.control, SHUTDOWN) !== 0; }
+  stateOf(seq){ return Atomics.load(this.control, this.slot(seq) + STATE); }
+
+  // --- producer (main thread) -----------------------------------------------
+
+  /**
+   * Publish a job whose payload was written at an arena offset
+   *
+   * @param seq the job sequence number (must be the current head)
+   */
+  publish(seq, jobId, moduleIndex, offset, length){
+    const s = this.slot(seq);
+    this.control[s + JOB_ID] = jobId;
+    this.control[s + MODULE] = moduleIndex;
+    this.control[s + OFFSET] = offset;
+    this.control[s + LENGTH] = length;
+    Atomics.store(this.control, s + STATE, READY);
+    Atomics.store(this.control, HEAD, seq + 1);
+    Atomics.notify(this.control, HEAD);
+  }
+  release(seq){
+    Atomics.store(this.control, this.slot(seq) + STATE, EMPTY);
+  }
+  shutdown(){
+    Atomics.store(this.control, SHUTDOWN, 1);
+    Atomics.notify(this.control, HEAD);
+  }
+
+  // --- consumers (workers) --------------------------------------------------
+
+  /**
+   * Claim and decode the next job, blocking until one is available
+   *
+   * @param timeout maximum waiting time in ms
+   * @return { jobId, module, payload } or null (timeout or shutdown)
+   */
+  take(timeout = Infinity){
+    for(;;){
+      if(this.isShutdown())
+        return null;
+      const seq = this.claimed();
+      const head = this.head();
+      if(seq >= head){
+        if(Atomics.wait(this.control, HEAD, head, timeout) === 'timed-out')
+          return null;
+        continue;
+      }
+      if(Atomics.compareExchange(this.control, CLAIM, seq, seq + 1) !== seq)
+        continue; // claimed by another worker
+      const s = this.slot(seq);
+      const jobId = this.control[s + JOB_ID];
+      const moduleIndex = this.control[s + MODULE];
+      const payload = decodePayload(
+        this.arena, this.control[s + OFFSET], this.control[s + LENGTH]
+      );
+      Atomics.store(this.control, s + STATE, DECODED);
+      return { jobId, module: MODULES[moduleIndex], payload };
+    }
+  }
+}
+
+/**
+ * FIFO allocator of the payload arena (main thread only)
+ */
+class ArenaAllocator {
+  constructor(size){
+    this.size = size;
+    this.head = 0;
+    this.tail = 0;
+    this.allocs = []; // [start, end] in allocation order
+  }
+
+  allocate(bytes){
+    bytes = Math.ceil(bytes / 8) * 8;
+    let start = -1;
+    if(!this.allocs.length){
+      this.head = this.tail = 0;
+      if(bytes <= this.size)
+        start = 0;
+    } else if(this.head > this.tail){
+      // free space in [head, size) and [0, tail)
+      if(this.size - this.head >= bytes)
+        start = this.head;
+      else if(this.tail > bytes)
+        start = 0;
+    } else if(this.tail - this.head > bytes){
+      // free space in [head, tail)
+      start = this.head;
+    }
+    if(start < 0)
+      return -1;
+    this.head = start + bytes;
+    this.allocs.push([start, start + bytes]);
+    return start;
+  }
+
+  // free the oldest allocation
+  free(){
+    this.allocs.shift();
+    this.tail = this.allocs.length ? this.allocs[0][0] : this.head;
+  }
+}
+
+module.exports = {
+  JobRing,
+  ArenaAllocator,
+  MODULES,
+  READY, DECODED,
+  hasSharedMemory,
+  encodePayload,
+  decodePayload,
+  transferablesOf
+};
@@ -0,0 +1,132 @@
+// Alexandre Kaspar <akaspar@mit.edu>
+"use strict";
+
+// modules
+const {
+  JobRing, MODULES, transferablesOf
+} = require('./jobring.js');
+
+// module factories and their location
+const factories = {
+  global: () => require('../../libs/nlopt-wasm/global_sampling.js'),
+  local:  () => require('../../libs/nlopt-wasm/local_sampling.js'),
+  sr:     () => require('../../libs/nlopt-wasm/sr_sampling.js'),
+  gdist:  () => require('../../libs/geodesic-dist/gdist.js'),
+  xfer:   () => require('../../libs/autoknit-wasm/plan_transfers.js')
+};
+const directories = {
+  global: 'libs/nlopt-wasm',
+  local:  'libs/nlopt-wasm',
+  sr:     'libs/nlopt-wasm',
+  gdist:  'libs/geodesic-dist',
+  xfer:   'libs/autoknit-wasm'
+};
+
+/**
+ * Composite jobs, which are not a single module method call.
+ * Each takes the module instance and the job arguments.
+ */
+const composites = {
+  gdist: {
+    // all distances from a list of sources (rows of a matrix)
+    distancesFrom(gd, { faces, edges, sources, params = {} }){
+      gd.precompute(faces, edges, params);
+      let dist = null;
+      for(let i = 0; i < sources.length; ++i){
+        const darr = gd.distancesTo(sources[i]);
+        if(!dist)
+          dist = new darr.constructor(sources.length * darr.length);
+        dist.set(darr, i * darr.length);
+      }
+      return dist;
+    }
+  }
+};
+
+function loadModules(names, moduleOptions){
+  const instances = {};
+  return Promise.all(names.map(name => {
+    const opts = moduleOptions(name, directories[name]);
+    return factories[name]()(opts).then(m => {
+      instances[name] = m;
+    });
+  })).then(() => instances);
+}
+
+// emscripten options to locate the wasm files from the page
+function browserOptions(name, directory){
+  const { basePath } = require('../wasm.js');
+  return {
+    locateFile: path => basePath + '/' + directory + '/' + path
+  };
+}
+
+/**
+ * Execute a job { method, args } over the module instances
+ *
+ * @return { result, buffers } or { error }
+ */
+function runJob(instances, moduleName, { method, args = [] }){
+  const m = instances[moduleName];
+  try {
+    if(!m)
+      throw new Error('Module ' + moduleName + ' is not loaded in this worker');
+    const comp = composites[moduleName] && composites[moduleName][method];
+    let result;
+    if(comp)
+      result = comp(m, ...args);
+    else if(typeof m[method] === 'function')
+      result = m[method](...args);
+    else
+      throw new Error('Invalid method ' + method + ' of module ' + moduleName);
+    // /!\ views over the wasm heap must be copied
+    return transferablesOf(result, m.HEAPU8 ? [m.HEAPU8.buffer] : []);
+  } catch(err){
+    return { error: err.message || String(err) };
+  }
+}
+
+/**
+ * Worker hosting solver modules.
+ *
+ * The first message { modules, ring } loads the modules and starts the job loop
+ * over the shared ring (if any), else jobs are received by message { job }.
+ *
+ * @param self the worker scope
+ * @param moduleOptions (name, directory) => emscripten module options
+ */
+module.exports = function(self, moduleOptions = browserOptions){
+  let instances = null;
+  const post = (jobId, { result, buffers, error }) => {
+    if(error)
+      self.postMessage({ jobId, error });
+    else
+      self.postMessage({ jobId, result }, buffers);
+  };
+  self.addEventListener('message', function(event){
+    const data = event.data;
+    if(data.modules){
+      loadModules(data.modules, moduleOptions).then(inst => {
+        instances = inst;
+        self.postMessage({ ready: true });
+        if(!data.ring)
+          return;
+        // shared ring loop (blocks this worker until shutdown)
+        const ring = JobRing.fromData(data.ring);
+        for(let job = ring.take(); job || !ring.isShutdown(); job = ring.take()){
+          if(job)
+            post(job.jobId, runJob(instances, job.module, job.payload));
+        }
+        self.postMessage({ closed: true });
+
+      }).catch(err => {
+        self.postMessage({ ready: false, error: err.message || String(err) });
+      });
+
+    } else if(data.job){
+      // message-based job
+      const { jobId, module: moduleIndex, payload } = data.job;
+      post(jobId, runJob(instances, MODULES[moduleIndex], payload));
+    }
+  });
+};
@@ -10,13 +10,11 @@ const Timer = require('../../timer.js');
 const { FibQueue, PairingQueue } = require('../../ds/pqueue.js');
 const RefinedDistanceQueryResult = require('./geodesic.js');
 // wasm for heap method
-const { basePath } = require('../../wasm.js');
+const wasm = require('../../wasm.js');
 const gd_module = require('../../../libs/geodesic-dist/gdist.js');
-let gd = gd_module({
-  locateFile: function(path){
-    return basePath + '/libs/geodesic-dist/' + path;
-  }
-}).then(g => gd = g);
+let gd = wasm.load('gdist', gd_module, 'libs/geodesic-dist');
+if(gd)
+  gd.then(g => gd = g);
 
 // constants
 const MAX_UINT32 = 0xFFFFFFFF;
@@ -317,9 +315,8 @@ class DistanceSampler {
       const darr = gd.distancesTo(i);
       assert(geom.approximately(darr[i], 0.0),
         'Self distance is non-zero!');
-      for(let j = 0; j < N; ++j){
-        this.dist.set(i, j, 0, darr[j]);
-      }
+      // row i is contiguous (single channel)
+      this.dist.data.set(darr, i * N);
       // use exact 1-ring distance
       this.dist.set(i, i, 0, 0);
       for(const [j, d] of this.neighborsOf(i))
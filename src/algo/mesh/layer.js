@@ -19,6 +19,15 @@ const NONE = 0;
 const REGULAR = 1;
 const INTERMEDIATE = 2;
 
+// raster canvas creation
+// /!\ the DOM is not available in Node, which needs another factory
+let createCanvas = (width, height) => {
+  const canvas = document.createElement('canvas');
+  canvas.width = width;
+  canvas.height = height;
+  return canvas;
+};
+
 /**
  * Piece of mesh raster element
  * associated with a single sketch.
@@ -321,9 +330,7 @@ class MeshLayer {
   getRasterData(computeChildRaster = this.constraintRaster.bind(this)){
     const eta = this.eta;
     assert(eta, 'Missing eta value');
-    const canvas = document.createElement('canvas');
-    canvas.width = this.fgrid.width;
-    canvas.height = this.fgrid.height;
+    const canvas = createCanvas(this.fgrid.width, this.fgrid.height);
     // XXX switch to OffscreenCanvas with web worker when possible
     const ctx = canvas.getContext('2d', { alpha: false });
 
@@ -1262,4 +1269,15 @@ class MeshLayer {
   }
 }
 
-module.exports = Object.assign(MeshLayer, M, { constants: M, Grid: MeshGrid });
+/**
+ * Set the canvas factory used for rasterizing sketches
+ *
+ * @param factory (width, height) => canvas with a 2d context
+ */
+function setCanvasFactory(factory){
+  createCanvas = factory;
+}
+
+module.exports = Object.assign(MeshLayer, M, {
+  constants: M, Grid: MeshGrid, setCanvasFactory
+});
@@ -4,13 +4,11 @@
 // modules
 const assert = require('../../assert.js');
 const Timer = require('../../timer.js');
-const { basePath } = require('../../wasm.js');
+const wasm = require('../../wasm.js');
 const gs_module = require('../../../libs/nlopt-wasm/global_sampling.js');
-let gs = gs_module({
-  locateFile: function(path){
-    return basePath + '/libs/nlopt-wasm/' + path;
-  }
-}).then(g => gs = g);
+let gs = wasm.load('global', gs_module, 'libs/nlopt-wasm');
+if(gs)
+  gs.then(g => gs = g);
 
 /**
  * Stitch Number node with connectivity constraint and wale term
@@ -370,7 +368,9 @@ class SNBranchAndBound {
 
     // attempt to get better pivot position using NLOpt
     // = solving the NLP problem without integer constraints
-    const sn_nlopt = gs.nlopt_optimize({
+    // + repair its rounding into an integer-feasible incumbent
+    //   (unless the module predates the repair stage)
+    const params = {
       cdata: this.cdata, wdata: this.wdata, nodes: this.nodes,
       weights: [
         this.courseAccWeight, this.simplicityWeight
@@ -379,7 +379,12 @@ class SNBranchAndBound {
       aliasingLevel: this.aliasingLevel,
       constraintTol: 2, // we allow one stitch error on each side
       verbose: this.debugWasm
-    });
+    };
+    const { values: sn_nlopt, integer: sn_repair } = (
+      typeof gs.repair_optimize === 'function'
+    ) ? gs.repair_optimize(params) : {
+      values: gs.nlopt_optimize(params), integer: null
+    };
 
     // check relaxed error (for pivot locations, not solution!)
     const nloptRelState = this.order.relaxedState(sn_nlopt);
@@ -404,6 +409,20 @@ class SNBranchAndBound {
       if(this.verbose)
         console.log('The initial solution is valid');
     }
+
+    // check repaired integer solution
+    if(sn_repair){
+      const repairState = this.order.newState(sn_repair);
+      if(repairState.error < this.snErr){
+        this.sn0    = repairState.sn.slice();
+        this.sn     = repairState.sn.slice();
+        this.enforceUserConstraints();
+        this.snErr  = repairState.error;
+        this.sols.push([this.sn, this.snErr]);
+        if(this.verbose)
+          console.log('The repaired solution is valid');
+      }
+    }
   }
 
   enforceUserConstraints(sn = this.sn){
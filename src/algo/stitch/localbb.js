@@ -4,13 +4,11 @@
 // modules
 const assert = require('../../assert.js');
 const SNBranchAndBound = require('./branchbound.js');
-const { basePath } = require('../../wasm.js');
+const wasm = require('../../wasm.js');
 const ls_module = require('../../../libs/nlopt-wasm/local_sampling.js');
-let ls = ls_module({
-  locateFile: function(path){
-    return basePath + '/libs/nlopt-wasm/' + path;
-  }
-}).then(l => ls = l);
+let ls = wasm.load('local', ls_module, 'libs/nlopt-wasm');
+if(ls)
+  ls.then(l => ls = l);
 
 // constants
 const MaxNumStitches = 1e4;
@@ -30,6 +28,7 @@ class LocalBranchAndBound extends SNBranchAndBound {
     this.lenStart = params.lenStart;
     this.lenEnd   = params.lenEnd;
     this.localScaling = params.localScaling;
+    this.integerDP = 'integerDP' in params ? !!params.integerDP : true;
     // global minima and maxima based on first/end and shaping
     this.snMin   = [];
     this.snMax   = [];
@@ -108,6 +107,10 @@ class LocalBranchAndBound extends SNBranchAndBound {
       this.snErr = this.getErrorImpl([], 0, this.order);
       this.iter = 1; // so that we can be done without iterating
 
+    } else if(this.getExactValue()){
+      // no branch to explore
+      this.iter = 1;
+
     } else {
       // get initial value
       this.getInitialValue();
@@ -117,6 +120,43 @@ class LocalBranchAndBound extends SNBranchAndBound {
     }
   }
 
+  /**
+   * Solve the chain exactly with the integer dynamic programming of wasm,
+   * which replaces the branch and bound search when available
+   * (else the search falls back to branch and bound).
+   *
+   * @return whether an optimal solution was found
+   */
+  getExactValue(){
+    // the wasm solver clamps the shaping factor to [1.01, 2]
+    // /!\ the export is missing from older module builds
+    if(!this.integerDP
+    || this.shapingFactor < 1.01
+    || this.shapingFactor > 2
+    || typeof ls.integer_optimize !== 'function')
+      return false;
+    const res = ls.integer_optimize({
+      cdata: this.cdata, start: this.snStart, end: this.snEnd,
+      weights: [
+        this.courseAccWeight, this.simplicityWeight
+      ],
+      shaping: this.shapingFactor,
+      min: this.snMin, max: this.snMax,
+      verbose: this.debugWasm
+    });
+    if(!res)
+      return false; // let the branch and bound report it
+    const state = this.order.newState(res.sn);
+    if(!Number.isFinite(state.error))
+      return false;
+    this.sn     = state.sn.slice();
+    this.snErr  = state.error;
+    this.sols.push([this.sn, this.snErr]);
+    if(this.verbose)
+      console.log('Exact integer solution, error=' + this.snErr);
+    return true;
+  }
+
   getInitialValue(){
 
     // use cdata a first initial value for pivots
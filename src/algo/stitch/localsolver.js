@@ -208,7 +208,7 @@ class LocalSolver {
           if(!state.srSolvers)
             this.initSRSolvers(state);
           // go over more iterations
-          const done = state.srSolvers.map(srs => srs.iterate());
+          const done = SRSolver.iterateAll(state.srSolvers);
           if(done.every(d => d)){
             const werr = state.srSolvers.reduce((sum, srs) => {
               return sum + srs.error;
@@ -5,13 +5,11 @@
 const assert = require('../../assert.js');
 const geom = require('../../geom.js');
 const Timer = require('../../timer.js');
-const { basePath } = require('../../wasm.js');
+const wasm = require('../../wasm.js');
 const sr_module = require('../../../libs/nlopt-wasm/sr_sampling.js');
-let sr = sr_module({
-  locateFile: function(path){
-    return basePath  + '/libs/nlopt-wasm/' + path;
-  }
-}).then(m => sr = m);
+let sr = wasm.load('sr', sr_module, 'libs/nlopt-wasm');
+if(sr)
+  sr.then(m => sr = m);
 const dtw = require('./dtw.js');
 
 // constants
@@ -387,6 +385,54 @@ class SRSolver {
     }
   }
 
+  needsSolve(){
+    // only use the solver if there is a chance for some non-zero solution
+    // => we must have one expSR[i] >= 0.5
+    return this.mode === SR_QIP
+        && this.expSR.some(r => r >= 0.5);
+  }
+
+  getProblem(){
+    return {
+      cdata: this.expSR,
+      weights: [ this.waleWeight, this.simpWeight ],
+      circular: this.circular,
+      simplicityPower: this.simpPower
+    };
+  }
+
+  setSolution(values){
+    this.sr = Array.from(values);
+    this.enforceSRConstraint();
+    this.error = this.getError();
+  }
+
+  /**
+   * Iterate a group of solvers, solving all their
+   * non-trivial short-row problems in a single wasm call
+   * 
+   * @param {SRSolver[]} solvers the list of solvers
+   * @return {boolean[]} whether each solver is done
+   */
+  static iterateAll(solvers){
+    const batch = solvers.filter(srs => srs.needsSolve());
+    // /!\ modules built without batch support solve each row separately
+    if(batch.length < 2 || typeof sr.batch_optimize !== 'function')
+      return solvers.map(srs => srs.iterate());
+    const { values, offsets, codes } = sr.batch_optimize(
+      batch.map(srs => srs.getProblem()), {
+        integer: true,
+        verbose: batch.some(srs => srs.debugWasm)
+      }
+    );
+    batch.forEach((srs, r) => {
+      assert(codes[r] >= 0, 'Short-row batch failed', codes[r]);
+      srs.setSolution(values.subarray(offsets[r], offsets[r + 1]));
+    });
+    const batched = new Set(batch);
+    return solvers.map(srs => batched.has(srs) || srs.iterate());
+  }
+
   iterate(){
     // in singular case, don't do anything
     if(!this.expSR.length){
@@ -407,27 +453,29 @@ class SRSolver {
         this.error = this.getError();
         return true;
       
-      // solve relaxed QP problem, then round to integer
+      // solve integer QP problem exactly (dynamic programming)
       case SR_QIP: {
-        // only use NLOpt if there is a chance for some non-zero solution
-        // => we must have one expSR[i] >= 0.5
-        if(this.expSR.some(r => r >= 0.5)){
+        if(this.needsSolve()){
           // potentially non-trivial solution
-          const sr0 = sr.nlopt_optimize({
-            cdata: this.expSR,
-            weights: [ this.waleWeight, this.simpWeight ],
-            circular: this.circular,
-            simplicityPower: Math.max(1, this.simpPower),
-            verbose: this.debugWasm
-          });
-          this.sr0 = sr0;
-          this.sr = sr0.map(v => Math.max(0, Math.round(v)));
-          this.enforceSRConstraint();
+          if(typeof sr.integer_optimize === 'function'){
+            this.setSolution(sr.integer_optimize(Object.assign(
+              this.getProblem(), { verbose: this.debugWasm }
+            )));
+          } else {
+            // module built without the integer solver
+            // => solve relaxed problem, then round to integer
+            const sr0 = sr.nlopt_optimize(Object.assign(this.getProblem(), {
+              simplicityPower: Math.max(1, this.simpPower),
+              verbose: this.debugWasm
+            }));
+            this.sr0 = sr0;
+            this.setSolution(sr0.map(v => Math.max(0, Math.round(v))));
+          }
         } else {
           // trivial solution
           this.sr = this.expSR.map(() => 0);
+          this.error = this.getError();
         }
-        this.error = this.getError();
         return true;
       }
 
@@ -4,12 +4,10 @@
 // modules
 const assert = require('../assert.js');
 const xfer_module = require('../../libs/autoknit-wasm/plan_transfers.js');
-const { basePath } = require('../wasm.js');
-let xfer = typeof location !== 'undefined' ? xfer_module({
-  locateFile: function(path){
-    return basePath + '/libs/autoknit-wasm/' + path;
-  }
-}).then(m => xfer = m) : null;
+const wasm = require('../wasm.js');
+let xfer = wasm.load('xfer', xfer_module, 'libs/autoknit-wasm');
+if(xfer)
+  xfer = xfer.then(m => xfer = m);
 const { Needle, LEFT, RIGHT } = require('./knitout.js');
 
 function setRacking(k, state, racking = 0){
@@ -4,8 +4,75 @@
 // modules
 const fs = require('fs');
 const pathData = fs.readFileSync(__dirname + '/../basepath.json');
-const basePath = location.origin + JSON.parse(pathData);
+const basePath = typeof location !== 'undefined' ? location.origin + JSON.parse(pathData) : null;
+
+// emscripten options (name, directory) => options
+// by default, the wasm files are located from the page
+let moduleOptions = basePath === null ? null : (name, directory) => {
+  return {
+    locateFile: path => basePath + '/' + directory + '/' + path
+  };
+};
+const instances = {};
+const pending = [];
+const listeners = [];
+
+/**
+ * Instantiate a wasm module
+ *
+ * @param name the module name ('global', 'local', 'sr', 'gdist' or 'xfer')
+ * @param factory the emscripten module factory
+ * @param directory the module directory (relative to the base path)
+ * @return a promise of the module, or null without module options
+ *         (e.g. in Node without a call to setModuleOptions)
+ */
+function load(name, factory, directory){
+  if(!moduleOptions)
+    return null;
+  const promise = factory(moduleOptions(name, directory)).then(m => {
+    instances[name] = m;
+    for(const callback of listeners)
+      callback(name, m);
+    return m;
+  });
+  pending.push(promise);
+  return promise;
+}
+
+/**
+ * Promise resolved when all the modules loaded so far are ready
+ */
+function ready(){
+  return Promise.all(pending).then(() => instances);
+}
+
+/**
+ * Set the emscripten module options for the next loads.
+ * This must be called before requiring the modules that use wasm.
+ *
+ * @param options (name, directory) => emscripten module options
+ */
+function setModuleOptions(options){
+  moduleOptions = options;
+}
+
+/**
+ * Register a callback for loaded modules
+ * (called immediately for the modules already loaded)
+ *
+ * @param callback (name, module) => void
+ */
+function onLoad(callback){
+  listeners.push(callback);
+  for(const name in instances)
+    callback(name, instances[name]);
+}
 
 module.exports = {
-  basePath
-};
\ No newline at end of file
+  basePath,
+  load,
+  ready,
+  setModuleOptions,
+  onLoad,
+  instances
+};
@@ -0,0 +1,66 @@
+"use strict";
+
+const test = require('tape');
+const {
+  ArenaAllocator, encodePayload, decodePayload
+} = require('../src/algo/jobring.js');
+
+// encode into an arena at a given offset, and decode from there
+function roundTrip(payload, offset = 0){
+  const bytes = encodePayload(payload);
+  const arena = new Uint8Array(offset + bytes.length);
+  arena.set(bytes, offset);
+  return decodePayload(arena, offset, bytes.length);
+}
+
+test('payload round-trip', t => {
+  const weights = new Float64Array([0, 1.5, Infinity]);
+  const faces = new Uint32Array([0, 1, 2, 2, 1, 3]);
+  const payload = roundTrip({
+    method: 'solveField',
+    args: [[1, Infinity, -Infinity, NaN], weights, faces, undefined, null],
+    params: { name: 'x', scale: 2, missing: undefined }
+  }, 8);
+  const [values, w, f, none, empty] = payload.args;
+  t.equal(payload.method, 'solveField');
+  t.deepEqual(values.slice(0, 3), [1, Infinity, -Infinity]);
+  t.ok(Number.isNaN(values[3]), 'NaN is kept');
+  t.ok(w instanceof Float64Array, 'typed arrays keep their type');
+  t.deepEqual(Array.from(w), Array.from(weights));
+  t.ok(f instanceof Uint32Array, 'typed arrays keep their type');
+  t.deepEqual(Array.from(f), Array.from(faces));
+  t.equal(payload.args.length, 5, 'undefined entries keep their position');
+  t.equal(none, undefined);
+  t.equal(empty, null);
+  t.deepEqual(payload.params, { name: 'x', scale: 2 });
+  t.end();
+});
+
+test('payload is copied out of the arena', t => {
+  const bytes = encodePayload({ data: new Float32Array([1, 2, 3]) });
+  const arena = new Uint8Array(bytes);
+  const { data } = decodePayload(arena, 0, bytes.length);
+  arena.fill(0);
+  t.deepEqual(Array.from(data), [1, 2, 3]);
+  t.end();
+});
+
+test('arena allocator wrap-around', t => {
+  const alloc = new ArenaAllocator(64);
+  t.equal(alloc.allocate(20), 0, 'sizes are 8-byte aligned');
+  t.equal(alloc.allocate(24), 24);
+  alloc.free(); // [24, 48) left
+  t.equal(alloc.allocate(24), -1, 'no room at the end nor before the tail');
+  t.equal(alloc.allocate(16), 48, 'fills the end');
+  alloc.free(); // [48, 64) left
+  t.equal(alloc.allocate(24), 0, 'wraps around to the start');
+  t.equal(alloc.allocate(24), -1, 'head cannot catch up with the tail');
+  t.equal(alloc.allocate(16), 24);
+  alloc.free();
+  alloc.free();
+  alloc.free();
+  t.equal(alloc.allocs.length, 0);
+  t.equal(alloc.allocate(64), 0, 'empty arena restarts at zero');
+  t.equal(alloc.allocate(8), -1, 'full arena');
+  t.end();
+});